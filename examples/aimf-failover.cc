@@ -0,0 +1,148 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+// Failover gap between two gateways.
+//
+//   source   gwA   gwB
+//     |       |     |
+//   ==================  LAN (AIMF)
+//             |     |
+//   ==================  MANET
+//
+// gwA (willingness high) forwards a 100 packets/s multicast flow onto the
+// MANET until, at 20 s, it either stops AIMF, lowers its willingness or
+// loses its LAN interface without a word. gwB (willingness default) takes
+// over. For each case the program prints the longest time without a
+// packet forwarded onto the MANET, in ms, up to the end of the flow, so a
+// gateway that never takes over shows as a gap as long as the outage. A stop and a demotion are
+// announced with a GOODBYE message, the lost interface is only noticed
+// when the neighbor hold time runs out.
+//
+//   ./waf --run "aimf-failover"
+
+#include <iostream>
+#include <iomanip>
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/aimf-helper.h"
+#include "ns3/aimf-routing-protocol.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE("AimfFailover");
+
+enum FailureMode {
+    STOP,
+    DEMOTE,
+    SILENT
+};
+
+struct ForwardingGap {
+    Time last;
+    Time longest;
+};
+
+static void
+Forwarded(ForwardingGap *gap, Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t interface) {
+    Time now = Simulator::Now();
+    if (!gap->last.IsZero() && now - gap->last > gap->longest) {
+        gap->longest = now - gap->last;
+    }
+    gap->last = now;
+}
+
+static void
+SendData(Ptr<Socket> socket, Ipv4Address group) {
+    socket->SendTo(Create<Packet> (100), 0, InetSocketAddress(group, 9));
+}
+
+static Time
+RunScenario(FailureMode mode) {
+    ForwardingGap gap;
+    Ipv4Address group("225.1.2.4");
+    Time trafficStart = Seconds(10);
+    Time trafficEnd = Seconds(40);
+
+    NodeContainer source;
+    source.Create(1);
+    NodeContainer gateways;
+    gateways.Create(2);
+
+    SimpleNetDeviceHelper simple;
+    NetDeviceContainer lan = simple.Install(NodeContainer(source, gateways));
+    NetDeviceContainer manet = simple.Install(gateways);
+
+    AimfHelper aimf;
+    for (uint32_t i = 0; i < gateways.GetN(); i++) {
+        aimf.ExcludeInterface(gateways.Get(i), 2);
+        aimf.SetMANETNetDeviceID(gateways.Get(i), 2);
+    }
+    Ipv4StaticRoutingHelper staticRouting;
+    Ipv4ListRoutingHelper list;
+    list.Add(staticRouting, 0);
+    list.Add(aimf, 10);
+
+    InternetStackHelper internet;
+    internet.Install(source);
+    InternetStackHelper gatewayInternet;
+    gatewayInternet.SetRoutingHelper(list);
+    gatewayInternet.Install(gateways);
+
+    Ipv4AddressHelper ipv4;
+    ipv4.SetBase("10.1.1.0", "255.255.255.0");
+    Ipv4InterfaceContainer lanAddresses = ipv4.Assign(lan);
+    ipv4.SetBase("10.1.2.0", "255.255.255.0");
+    ipv4.Assign(manet);
+    staticRouting.SetDefaultMulticastRoute(source.Get(0), lan.Get(0));
+
+    Ptr<aimf::RoutingProtocol> gwA = gateways.Get(0)->GetObject<aimf::RoutingProtocol> ();
+    gwA->SetAttribute("Willingness", EnumValue(6));
+    for (uint32_t i = 0; i < gateways.GetN(); i++) {
+        Ptr<aimf::RoutingProtocol> gateway = gateways.Get(i)->GetObject<aimf::RoutingProtocol> ();
+        gateway->TraceConnectWithoutContext("McTx", MakeBoundCallback(&Forwarded, &gap));
+        Simulator::Schedule(Seconds(1), &aimf::RoutingProtocol::AddHostMulticastAssociation,
+                gateway, group, lanAddresses.GetAddress(0));
+    }
+
+    switch (mode) {
+        case STOP:
+            Simulator::Schedule(Seconds(20), &aimf::RoutingProtocol::DoStop, gwA);
+            break;
+        case DEMOTE:
+            Simulator::Schedule(Seconds(20), &aimf::RoutingProtocol::ChangeWillingness, gwA, 1);
+            break;
+        case SILENT:
+            Simulator::Schedule(Seconds(20), &Ipv4::SetDown, gateways.Get(0)->GetObject<Ipv4> (), 1);
+            break;
+    }
+
+    Ptr<Socket> socket = Socket::CreateSocket(source.Get(0), UdpSocketFactory::GetTypeId());
+    socket->Bind();
+    for (Time t = trafficStart; t < trafficEnd; t += MilliSeconds(10)) {
+        Simulator::Schedule(t, &SendData, socket, group);
+    }
+
+    Simulator::Stop(trafficEnd);
+    Simulator::Run();
+    // The outage after the last forwarded packet counts too, nothing
+    // forwarded at all is an outage of the whole flow.
+    Time last = gap.last.IsZero() ? trafficStart : gap.last;
+    if (trafficEnd - last > gap.longest) {
+        gap.longest = trafficEnd - last;
+    }
+    Simulator::Destroy();
+    return gap.longest;
+}
+
+int
+main(int argc, char *argv[]) {
+    CommandLine cmd;
+    cmd.Parse(argc, argv);
+
+    std::cout << std::setw(12) << "failure" << std::setw(12) << "gap (ms)" << std::endl;
+    std::cout << std::setw(12) << "stop" << std::setw(12) << RunScenario(STOP).GetMilliSeconds() << std::endl;
+    std::cout << std::setw(12) << "demote" << std::setw(12) << RunScenario(DEMOTE).GetMilliSeconds() << std::endl;
+    std::cout << std::setw(12) << "silent" << std::setw(12) << RunScenario(SILENT).GetMilliSeconds() << std::endl;
+    return 0;
+}
@@ -0,0 +1,160 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+// Forwarding throughput of one gateway, with and without trace sinks.
+//
+//   source   gw
+//     |       |
+//   ============  LAN (AIMF)
+//             |
+//   ============  MANET
+//
+// The source sends a burst of multicast packets that gw forwards onto the
+// MANET. The burst is run twice, once with sinks on McRx and McTx and once
+// without, and the program prints the wall clock time of each run and the
+// packets forwarded per second of it.
+//
+// With --log the AimfRoutingProtocol component logs at every level into a
+// stream that discards the text. Run so in a build with logging enabled,
+// configured once with and once without --disable-aimf-datapath-log, the
+// difference is the cost of the per packet logging of the forwarding path.
+//
+//   ./waf --run "aimf-forwarding-benchmark --packets=200000"
+//   ./waf --run "aimf-forwarding-benchmark --packets=200000 --log=1"
+
+#include <iostream>
+#include <iomanip>
+#include <streambuf>
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/aimf-helper.h"
+#include "ns3/aimf-routing-protocol.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE("AimfForwardingBenchmark");
+
+static void
+CountPacket(uint64_t *count, Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t interface) {
+    (*count)++;
+}
+
+// Takes the log text and drops it, so the run measures the logging and not the terminal.
+class DiscardBuffer : public std::streambuf {
+protected:
+
+    virtual int overflow(int c) {
+        return traits_type::not_eof(c);
+    }
+
+    virtual std::streamsize xsputn(const char *s, std::streamsize n) {
+        return n;
+    }
+};
+
+static void
+SendData(Ptr<Socket> socket, Ipv4Address group) {
+    socket->SendTo(Create<Packet> (100), 0, InetSocketAddress(group, 9));
+}
+
+static int64_t
+RunScenario(uint32_t packets, bool tracing, uint64_t *received, uint64_t *forwarded) {
+    Ipv4Address group("225.1.2.4");
+
+    NodeContainer source;
+    source.Create(1);
+    NodeContainer gateway;
+    gateway.Create(1);
+
+    SimpleNetDeviceHelper simple;
+    NetDeviceContainer lan = simple.Install(NodeContainer(source, gateway));
+    NetDeviceContainer manet = simple.Install(gateway);
+
+    AimfHelper aimf;
+    aimf.Set("Willingness", EnumValue(7));
+    aimf.ExcludeInterface(gateway.Get(0), 2);
+    aimf.SetMANETNetDeviceID(gateway.Get(0), 2);
+    Ipv4StaticRoutingHelper staticRouting;
+    Ipv4ListRoutingHelper list;
+    list.Add(staticRouting, 0);
+    list.Add(aimf, 10);
+
+    InternetStackHelper internet;
+    internet.Install(source);
+    InternetStackHelper gatewayInternet;
+    gatewayInternet.SetRoutingHelper(list);
+    gatewayInternet.Install(gateway);
+
+    Ipv4AddressHelper ipv4;
+    ipv4.SetBase("10.1.1.0", "255.255.255.0");
+    Ipv4InterfaceContainer lanAddresses = ipv4.Assign(lan);
+    ipv4.SetBase("10.1.2.0", "255.255.255.0");
+    ipv4.Assign(manet);
+    staticRouting.SetDefaultMulticastRoute(source.Get(0), lan.Get(0));
+
+    Ptr<aimf::RoutingProtocol> gw = gateway.Get(0)->GetObject<aimf::RoutingProtocol> ();
+    Simulator::Schedule(Seconds(1), &aimf::RoutingProtocol::AddHostMulticastAssociation,
+            gw, group, lanAddresses.GetAddress(0));
+    if (tracing) {
+        gw->TraceConnectWithoutContext("McRx", MakeBoundCallback(&CountPacket, received));
+        gw->TraceConnectWithoutContext("McTx", MakeBoundCallback(&CountPacket, forwarded));
+    }
+
+    Ptr<Socket> socket = Socket::CreateSocket(source.Get(0), UdpSocketFactory::GetTypeId());
+    socket->Bind();
+    for (uint32_t i = 0; i < packets; i++) {
+        Simulator::Schedule(Seconds(2) + MicroSeconds(10 * i), &SendData, socket, group);
+    }
+
+    SystemWallClockMs clock;
+    clock.Start();
+    Simulator::Stop(Seconds(3) + MicroSeconds(10 * packets));
+    Simulator::Run();
+    int64_t elapsed = clock.End();
+    Simulator::Destroy();
+    return elapsed;
+}
+
+static void
+Print(const std::string &name, uint32_t packets, int64_t ms) {
+    std::cout << std::setw(12) << name
+            << std::setw(12) << ms
+            << std::setw(16) << std::fixed << std::setprecision(0)
+            << (ms > 0 ? packets * 1000.0 / ms : 0.0) << std::endl;
+}
+
+int
+main(int argc, char *argv[]) {
+    uint32_t packets = 200000;
+    bool log = false;
+
+    CommandLine cmd;
+    cmd.AddValue("packets", "Number of multicast packets in the burst", packets);
+    cmd.AddValue("log", "Log AimfRoutingProtocol at every level into a discarded stream", log);
+    cmd.Parse(argc, argv);
+
+    DiscardBuffer discard;
+    std::streambuf *clogBuffer = std::clog.rdbuf();
+    if (log) {
+        LogComponentEnable("AimfRoutingProtocol", (LogLevel) (LOG_LEVEL_ALL | LOG_PREFIX_ALL));
+        std::clog.rdbuf(&discard);
+    }
+
+    uint64_t received = 0;
+    uint64_t forwarded = 0;
+    int64_t traced = RunScenario(packets, true, &received, &forwarded);
+    int64_t untraced = RunScenario(packets, false, &received, &forwarded);
+    std::clog.rdbuf(clogBuffer);
+
+    std::cout << "received " << received << ", forwarded " << forwarded
+            << " of " << packets << " packets" << std::endl;
+    if (log) {
+        std::cout << "AimfRoutingProtocol logging on, discarded" << std::endl;
+    }
+    std::cout << std::setw(12) << "tracing" << std::setw(12) << "wall (ms)"
+            << std::setw(16) << "packets/s" << std::endl;
+    Print("on", packets, traced);
+    Print("off", packets, untraced);
+    return 0;
+}
@@ -0,0 +1,137 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+// HELLO collisions between gateways that start together.
+//
+// 50 gateways share one ad hoc 802.11b channel, all within range of each
+// other, and start AIMF at the same instant. The scenario runs once with
+// MaxJitter set to 0 and once with the given jitter, and prints for each
+// run the HELLO loss rate (HELLOs that did not reach every other gateway)
+// and the number of neighbor expiries. No gateway ever leaves, so every
+// expiry is a false one.
+//
+//   ./waf --run "aimf-hello-jitter --gateways=50 --maxJitter=0.5s"
+
+#include <iostream>
+#include <iomanip>
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/wifi-module.h"
+#include "ns3/mobility-module.h"
+#include "ns3/aimf-helper.h"
+#include "ns3/aimf-routing-protocol.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE("AimfHelloJitter");
+
+struct HelloStats {
+    uint64_t sent;
+    uint64_t received;
+    uint64_t expiries;
+};
+
+static void
+HelloSent(HelloStats *stats, Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t interface) {
+    stats->sent++;
+}
+
+static void
+HelloReceived(HelloStats *stats, Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t interface) {
+    stats->received++;
+}
+
+static void
+NeighborLost(HelloStats *stats, const Ipv4Address &neighbor) {
+    stats->expiries++;
+}
+
+static HelloStats
+RunScenario(uint32_t gateways, Time maxJitter, Time duration) {
+    HelloStats stats = {0, 0, 0};
+
+    NodeContainer nodes;
+    nodes.Create(gateways);
+
+    WifiHelper wifi;
+    wifi.SetStandard(WIFI_PHY_STANDARD_80211b);
+    wifi.SetRemoteStationManager("ns3::ConstantRateWifiManager",
+            "DataMode", StringValue("DsssRate1Mbps"),
+            "ControlMode", StringValue("DsssRate1Mbps"));
+    YansWifiPhyHelper wifiPhy = YansWifiPhyHelper::Default();
+    YansWifiChannelHelper wifiChannel = YansWifiChannelHelper::Default();
+    wifiPhy.SetChannel(wifiChannel.Create());
+    NqosWifiMacHelper wifiMac = NqosWifiMacHelper::Default();
+    wifiMac.SetType("ns3::AdhocWifiMac");
+    NetDeviceContainer devices = wifi.Install(wifiPhy, wifiMac, nodes);
+
+    // 10 x 5 grid with 5 m spacing, every gateway hears every other one.
+    MobilityHelper mobility;
+    mobility.SetPositionAllocator("ns3::GridPositionAllocator",
+            "MinX", DoubleValue(0.0),
+            "MinY", DoubleValue(0.0),
+            "DeltaX", DoubleValue(5.0),
+            "DeltaY", DoubleValue(5.0),
+            "GridWidth", UintegerValue(10),
+            "LayoutType", StringValue("RowFirst"));
+    mobility.SetMobilityModel("ns3::ConstantPositionMobilityModel");
+    mobility.Install(nodes);
+
+    AimfHelper aimf;
+    aimf.Set("MaxJitter", TimeValue(maxJitter));
+    Ipv4StaticRoutingHelper staticRouting;
+    Ipv4ListRoutingHelper list;
+    list.Add(staticRouting, 0);
+    list.Add(aimf, 10);
+    InternetStackHelper internet;
+    internet.SetRoutingHelper(list);
+    internet.Install(nodes);
+
+    Ipv4AddressHelper ipv4;
+    ipv4.SetBase("10.1.2.0", "255.255.255.0");
+    ipv4.Assign(devices);
+
+    for (uint32_t i = 0; i < gateways; i++) {
+        Ptr<aimf::RoutingProtocol> gateway = nodes.Get(i)->GetObject<aimf::RoutingProtocol> ();
+        gateway->TraceConnectWithoutContext("Tx", MakeBoundCallback(&HelloSent, &stats));
+        gateway->TraceConnectWithoutContext("Rx", MakeBoundCallback(&HelloReceived, &stats));
+        gateway->TraceConnectWithoutContext("NeighborLost", MakeBoundCallback(&NeighborLost, &stats));
+    }
+
+    Simulator::Stop(duration);
+    Simulator::Run();
+    Simulator::Destroy();
+    return stats;
+}
+
+static void
+Print(const std::string &name, uint32_t gateways, const HelloStats &stats) {
+    double expected = (double) stats.sent * (gateways - 1);
+    double loss = expected > 0 ? 1.0 - stats.received / expected : 0.0;
+    std::cout << std::setw(12) << name
+            << std::setw(12) << stats.sent
+            << std::setw(12) << stats.received
+            << std::setw(12) << std::fixed << std::setprecision(2) << 100 * loss
+            << std::setw(12) << stats.expiries << std::endl;
+}
+
+int
+main(int argc, char *argv[]) {
+    uint32_t gateways = 50;
+    Time maxJitter = MilliSeconds(500);
+    Time duration = Seconds(60);
+
+    CommandLine cmd;
+    cmd.AddValue("gateways", "Number of gateways on the channel", gateways);
+    cmd.AddValue("maxJitter", "MaxJitter of the jittered run", maxJitter);
+    cmd.AddValue("duration", "Simulated time of each run", duration);
+    cmd.Parse(argc, argv);
+
+    std::cout << std::setw(12) << "run" << std::setw(12) << "hello tx"
+            << std::setw(12) << "hello rx" << std::setw(12) << "loss %"
+            << std::setw(12) << "expiries" << std::endl;
+    Print("no jitter", gateways, RunScenario(gateways, Seconds(0), duration));
+    Print("jitter", gateways, RunScenario(gateways, maxJitter, duration));
+    return 0;
+}
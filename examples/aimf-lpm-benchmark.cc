@@ -0,0 +1,124 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+// Micro-benchmark of the unicast route lookup of AIMF.
+//
+// For a growing number of routes with prefix lengths between /8 and /32,
+// it times LpmTable::Lookup for random destinations. The same lookups
+// against a list scan, which is how LookupStatic used to find its routes,
+// are printed as baseline.
+//
+//   ./waf --run "aimf-lpm-benchmark --lookups=200000"
+
+#include <iostream>
+#include <iomanip>
+#include <list>
+#include <vector>
+
+#include "ns3/core-module.h"
+#include "ns3/ipv4.h"
+#include "ns3/aimf-lpm-table.h"
+
+using namespace ns3;
+using namespace ns3::aimf;
+
+static double
+NsPerOp(SystemWallClockMs &clock, uint32_t ops) {
+    return clock.End() * 1e6 / ops;
+}
+
+// The loop of the old LookupStatic: longest mask, then lowest metric.
+static const Ipv4RoutingTableEntry*
+ListLookup(const std::list<std::pair<Ipv4RoutingTableEntry, uint32_t> > &routes, Ipv4Address dest) {
+    const Ipv4RoutingTableEntry *best = NULL;
+    uint16_t longestMask = 0;
+    uint32_t shortestMetric = 0xffffffff;
+    for (std::list<std::pair<Ipv4RoutingTableEntry, uint32_t> >::const_iterator i = routes.begin();
+            i != routes.end(); i++) {
+        Ipv4Mask mask = i->first.GetDestNetworkMask();
+        uint16_t masklen = mask.GetPrefixLength();
+        if (!mask.IsMatch(dest, i->first.GetDestNetwork()) || masklen < longestMask) {
+            continue;
+        }
+        if (masklen > longestMask) {
+            shortestMetric = 0xffffffff;
+        }
+        longestMask = masklen;
+        if (i->second > shortestMetric) {
+            continue;
+        }
+        shortestMetric = i->second;
+        best = &i->first;
+    }
+    return best;
+}
+
+int
+main(int argc, char *argv[]) {
+    uint32_t lookups = 200000;
+
+    CommandLine cmd;
+    cmd.AddValue("lookups", "Number of lookups per measurement", lookups);
+    cmd.Parse(argc, argv);
+
+    Ptr<UniformRandomVariable> random = CreateObject<UniformRandomVariable> ();
+    std::cout << std::setw(10) << "routes" << std::setw(16) << "trie ns/op"
+            << std::setw(16) << "list ns/op" << std::endl;
+
+    uint32_t sizes[] = {10, 100, 1000, 5000, 20000};
+    for (uint32_t s = 0; s < sizeof (sizes) / sizeof (sizes[0]); s++) {
+        uint32_t nRoutes = sizes[s];
+        LpmTable table;
+        std::list<std::pair<Ipv4RoutingTableEntry, uint32_t> > list;
+        for (uint32_t i = 0; i < nRoutes; i++) {
+            uint32_t length = random->GetInteger(8, 32);
+            Ipv4Mask mask(length == 32 ? 0xffffffff : ~(0xffffffff >> length));
+            Ipv4Address network(random->GetInteger(0, 0xfffffffe) & mask.Get());
+            Ipv4RoutingTableEntry entry = Ipv4RoutingTableEntry::CreateNetworkRouteTo(network, mask, 1 + i % 4);
+            uint32_t metric = random->GetInteger(1, 10);
+            table.Insert(entry, metric);
+            list.push_back(std::make_pair(entry, metric));
+        }
+        // Half the destinations are inside a known network, half are random.
+        std::vector<Ipv4Address> destinations;
+        for (std::list<std::pair<Ipv4RoutingTableEntry, uint32_t> >::const_iterator it = list.begin();
+                destinations.size() < lookups / 2; it++) {
+            if (it == list.end()) {
+                it = list.begin();
+            }
+            uint32_t host = random->GetInteger(0, 0xfffffffe) & ~it->first.GetDestNetworkMask().Get();
+            destinations.push_back(Ipv4Address(it->first.GetDestNetwork().Get() | host));
+        }
+        while (destinations.size() < lookups) {
+            destinations.push_back(Ipv4Address(random->GetInteger(0, 0xfffffffe)));
+        }
+
+        uint32_t trieHits = 0;
+        SystemWallClockMs clock;
+        clock.Start();
+        for (uint32_t n = 0; n < lookups; n++) {
+            trieHits += table.Lookup(destinations[n], Ipv4::IF_ANY) != NULL;
+        }
+        double trie = NsPerOp(clock, lookups);
+
+        uint32_t listHits = 0;
+        clock.Start();
+        for (uint32_t n = 0; n < lookups; n++) {
+            listHits += ListLookup(list, destinations[n]) != NULL;
+        }
+        double linear = NsPerOp(clock, lookups);
+
+        NS_ABORT_MSG_UNLESS(trieHits == listHits, "trie and list disagree on the routable destinations");
+        // Both must pick a route of the same prefix length.
+        for (uint32_t n = 0; n < lookups; n += 97) {
+            const LpmTable::Route *a = table.Lookup(destinations[n], Ipv4::IF_ANY);
+            const Ipv4RoutingTableEntry *b = ListLookup(list, destinations[n]);
+            NS_ABORT_MSG_UNLESS(a == NULL || a->entry.GetDestNetworkMask().GetPrefixLength()
+                    == b->GetDestNetworkMask().GetPrefixLength(), "trie and list disagree on " << destinations[n]);
+        }
+
+        std::cout << std::setw(10) << nRoutes
+                << std::setw(16) << std::fixed << std::setprecision(1) << trie
+                << std::setw(16) << linear << std::endl;
+    }
+    return 0;
+}
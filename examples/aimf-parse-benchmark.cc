@@ -0,0 +1,156 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+// Micro-benchmark of the parsing of received HELLO packets.
+//
+// For HELLOs with a growing number of associations, it times the
+// PacketReader walk that RecvAimf does, one copy of the packet bytes and
+// the association records read in place, against the header path it
+// replaced: a copy of the packet, RemoveHeader of every message into a
+// MessageList, and the associations of each HELLO in their own vector.
+// Both visit every association. It then checks that every truncation of
+// a packet is reported as malformed.
+//
+//   ./waf --run "aimf-parse-benchmark --packets=100000"
+
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/aimf-header.h"
+
+using namespace ns3;
+using namespace ns3::aimf;
+
+static Ptr<Packet>
+MakeHello(uint32_t nAssociations) {
+    MessageHeader msg;
+    msg.SetVTime(Seconds(6));
+    msg.SetOriginatorAddress(Ipv4Address("10.1.1.2"));
+    msg.SetTimeToLive(255);
+    msg.SetMessageSequenceNumber(1);
+    MessageHeader::Hello &hello = msg.GetHello();
+    hello.SetHTime(Seconds(2));
+    hello.willingness = 3;
+    hello.ansn = 1;
+    hello.flags = MessageHeader::Hello::FULL;
+    hello.fragment = 0;
+    hello.fragments = 1;
+    for (uint32_t n = 0; n < nAssociations; n++) {
+        MessageHeader::Hello::Association assoc = {Ipv4Address(0xe1000000 + n), 32, Ipv4Address(0x0a010100 + n % 256), 3};
+        hello.associations.push_back(assoc);
+    }
+    Ptr<Packet> packet = Create<Packet> ();
+    packet->AddHeader(msg);
+    PacketHeader header;
+    header.SetPacketLength(header.GetSerializedSize() + packet->GetSize());
+    header.SetPacketSequenceNumber(1);
+    packet->AddHeader(header);
+    return packet;
+}
+
+// What RecvAimf did before the PacketReader.
+static uint32_t
+ParseHeaders(Ptr<const Packet> receivedPacket) {
+    Ptr<Packet> packet = receivedPacket->Copy();
+    PacketHeader packetHeader;
+    packet->RemoveHeader(packetHeader);
+    uint32_t sizeLeft = packetHeader.GetPacketLength() - packetHeader.GetSerializedSize();
+    MessageList messages;
+    while (sizeLeft) {
+        MessageHeader messageHeader;
+        if (packet->RemoveHeader(messageHeader) == 0) {
+            break;
+        }
+        sizeLeft -= messageHeader.GetSerializedSize();
+        messages.push_back(messageHeader);
+    }
+    uint32_t sum = 0;
+    for (MessageList::const_iterator it = messages.begin(); it != messages.end(); it++) {
+        const MessageHeader::Hello &hello = it->GetHello();
+        for (uint32_t n = 0; n < hello.associations.size(); n++) {
+            sum += hello.associations[n].group.Get() + hello.associations[n].willGroupSSM;
+        }
+    }
+    return sum;
+}
+
+// What RecvAimf does now. Returns false for a malformed packet.
+static bool
+ParseReader(Ptr<const Packet> packet, std::vector<uint8_t> &buffer, uint32_t *sum) {
+    uint32_t size = packet->GetSize();
+    if (buffer.size() < size) {
+        buffer.resize(size);
+    }
+    if (size > 0) {
+        packet->CopyData(&buffer[0], size);
+    }
+    PacketReader reader(size > 0 ? &buffer[0] : NULL, size);
+    MessageView message;
+    while (reader.Next(message)) {
+        HelloView hello;
+        if (!PacketReader::ReadHello(message, hello)) {
+            return false;
+        }
+        uint32_t offset = 0;
+        for (uint32_t n = 0; n < hello.nAssociations; n++) {
+            MessageHeader::Hello::Association assoc = hello.ReadAssociation(offset);
+            *sum += assoc.group.Get() + assoc.willGroupSSM;
+        }
+    }
+    return !reader.IsMalformed();
+}
+
+int
+main(int argc, char *argv[]) {
+    uint32_t packets = 100000;
+
+    CommandLine cmd;
+    cmd.AddValue("packets", "Number of packets parsed per measurement", packets);
+    cmd.Parse(argc, argv);
+
+    std::vector<uint8_t> buffer;
+    std::cout << std::setw(14) << "associations" << std::setw(10) << "bytes"
+            << std::setw(16) << "reader ns/pkt" << std::setw(16) << "headers ns/pkt"
+            << std::setw(14) << "reader MB/s" << std::endl;
+
+    uint32_t sizes[] = {0, 1, 10, 100, 1000};
+    for (uint32_t s = 0; s < sizeof (sizes) / sizeof (sizes[0]); s++) {
+        Ptr<const Packet> packet = MakeHello(sizes[s]);
+        // Fewer rounds for the large packets, the same number of records.
+        uint32_t rounds = std::max<uint32_t> (packets / std::max<uint32_t> (sizes[s], 1), 100);
+
+        uint32_t readerSum = 0;
+        SystemWallClockMs clock;
+        clock.Start();
+        for (uint32_t n = 0; n < rounds; n++) {
+            NS_ABORT_MSG_UNLESS(ParseReader(packet, buffer, &readerSum), "the reader rejects a valid HELLO");
+        }
+        double reader = clock.End() * 1e6 / rounds;
+
+        uint32_t headersSum = 0;
+        clock.Start();
+        for (uint32_t n = 0; n < rounds; n++) {
+            headersSum += ParseHeaders(packet);
+        }
+        double headers = clock.End() * 1e6 / rounds;
+
+        NS_ABORT_MSG_UNLESS(readerSum == headersSum, "the reader and the headers read different associations");
+        std::cout << std::setw(14) << sizes[s] << std::setw(10) << packet->GetSize()
+                << std::setw(16) << std::fixed << std::setprecision(1) << reader
+                << std::setw(16) << headers
+                << std::setw(14) << (reader > 0 ? packet->GetSize() * 1e3 / reader : 0.0) << std::endl;
+    }
+
+    // Every truncation of a HELLO must be dropped, not assert.
+    Ptr<Packet> hello = MakeHello(10);
+    for (uint32_t size = 0; size < hello->GetSize(); size++) {
+        Ptr<Packet> truncated = hello->CreateFragment(0, size);
+        uint32_t sum = 0;
+        NS_ABORT_MSG_UNLESS(!ParseReader(truncated, buffer, &sum), "a HELLO truncated to " << size << " bytes is accepted");
+    }
+    std::cout << "all " << hello->GetSize() << " truncations of a HELLO are reported as malformed" << std::endl;
+    return 0;
+}
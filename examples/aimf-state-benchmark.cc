@@ -0,0 +1,114 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+// Micro-benchmark of the AimfState neighbor and association indexes.
+//
+// For a growing number of gateways and HMA tuples, it times the lookups
+// and updates ProcessHello does for every received HELLO. The same work
+// against a plain vector scan, which is how AimfState used to store its
+// tuples, is printed as baseline.
+//
+//   ./waf --run "aimf-state-benchmark --lookups=200000"
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+
+#include "ns3/core-module.h"
+#include "ns3/aimf-state.h"
+
+using namespace ns3;
+using namespace ns3::aimf;
+
+static Ipv4Address
+Gateway(uint32_t i) {
+    return Ipv4Address(0x0a010000 + i + 1);
+}
+
+static Ipv4Address
+Group(uint32_t i) {
+    return Ipv4Address(0xe1010000 + i);
+}
+
+static double
+NsPerOp(SystemWallClockMs &clock, uint32_t ops) {
+    return clock.End() * 1e6 / ops;
+}
+
+int
+main(int argc, char *argv[]) {
+    uint32_t lookups = 200000;
+    uint32_t groupsPerGateway = 10;
+
+    CommandLine cmd;
+    cmd.AddValue("lookups", "Number of lookups per measurement", lookups);
+    cmd.AddValue("groupsPerGateway", "HMA tuples advertised by every gateway", groupsPerGateway);
+    cmd.Parse(argc, argv);
+
+    std::cout << std::setw(10) << "gateways" << std::setw(10) << "tuples"
+            << std::setw(16) << "neigh ns/op" << std::setw(16) << "assoc ns/op"
+            << std::setw(16) << "update ns/op" << std::setw(16) << "vector ns/op" << std::endl;
+
+    uint32_t sizes[] = {10, 100, 1000, 5000};
+    for (uint32_t s = 0; s < sizeof (sizes) / sizeof (sizes[0]); s++) {
+        uint32_t gateways = sizes[s];
+        AimfState state;
+        std::vector<AssociationTuple> linear;
+        for (uint32_t i = 0; i < gateways; i++) {
+            NeighborTuple nb = {Gateway(i), Seconds(6), (uint8_t) (i % 8)};
+            state.InsertNeighborTuple(nb);
+            for (uint32_t g = 0; g < groupsPerGateway; g++) {
+                AssociationTuple tuple = {Gateway(i), Group(g), AIMF_SINGLE_GROUP_PREFIX, Gateway(i), Seconds(6), 3};
+                state.InsertAssociationTuple(tuple);
+                linear.push_back(tuple);
+            }
+        }
+        uint32_t tuples = gateways * groupsPerGateway;
+        uint32_t hits = 0;
+        SystemWallClockMs clock;
+
+        clock.Start();
+        for (uint32_t n = 0; n < lookups; n++) {
+            hits += state.FindNeighborTuple(Gateway(n % gateways)) != NULL;
+        }
+        double neigh = NsPerOp(clock, lookups);
+
+        clock.Start();
+        for (uint32_t n = 0; n < lookups; n++) {
+            uint32_t i = n % gateways;
+            hits += state.FindAssociationTuple(Gateway(i), Group(n % groupsPerGateway), AIMF_SINGLE_GROUP_PREFIX, Gateway(i)) != NULL;
+        }
+        double assoc = NsPerOp(clock, lookups);
+
+        // Expire and relearn a tuple, as a gateway leaving and coming back does.
+        clock.Start();
+        for (uint32_t n = 0; n < lookups; n++) {
+            uint32_t i = n % gateways;
+            AssociationTuple tuple = {Gateway(i), Group(n % groupsPerGateway), AIMF_SINGLE_GROUP_PREFIX, Gateway(i), Seconds(6), 3};
+            state.EraseAssociationTuple(tuple);
+            state.InsertAssociationTuple(tuple);
+        }
+        double update = NsPerOp(clock, lookups);
+
+        // The vector scan is slow, keep the number of lookups bounded.
+        uint32_t linearLookups = std::min<uint32_t> (lookups, 2000);
+        clock.Start();
+        for (uint32_t n = 0; n < linearLookups; n++) {
+            uint32_t i = n % gateways;
+            Ipv4Address group = Group(n % groupsPerGateway);
+            for (std::vector<AssociationTuple>::const_iterator it = linear.begin(); it != linear.end(); it++) {
+                if (it->advertiser == Gateway(i) && it->group == group && it->source == Gateway(i)) {
+                    hits++;
+                    break;
+                }
+            }
+        }
+        double scan = NsPerOp(clock, linearLookups);
+
+        NS_ABORT_MSG_UNLESS(hits == 2 * lookups + linearLookups, "lookups missed tuples");
+        std::cout << std::setw(10) << gateways << std::setw(10) << tuples
+                << std::setw(16) << neigh << std::setw(16) << assoc
+                << std::setw(16) << update << std::setw(16) << scan << std::endl;
+    }
+    return 0;
+}
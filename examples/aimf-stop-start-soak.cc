@@ -0,0 +1,142 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+// Soak test of DoStop/DoStart cycles.
+//
+//   source   gw0   gw1
+//     |       |     |
+//   ==================  LAN (AIMF)
+//             |     |
+//   ==================  MANET
+//
+// gw0 is stopped and started again every 100 ms of simulated time, for
+// the given number of cycles, while both gateways advertise a group.
+// Every sampleEvery cycles the program prints the number of unicast
+// routes and forwarding entries of gw0 and the cost of a route lookup.
+// It aborts if the routes or entries differ from the first sample, or if
+// a lookup costs more than maxSlowdown times what it did then.
+//
+//   ./waf --run "aimf-stop-start-soak --cycles=5000"
+
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/aimf-helper.h"
+#include "ns3/aimf-routing-protocol.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE("AimfStopStartSoak");
+
+struct SoakSample {
+    bool taken;
+    uint32_t routes;
+    uint32_t entries;
+    double nsPerLookup;
+};
+
+static void
+Sample(Ptr<aimf::RoutingProtocol> gw, SoakSample *first, uint32_t cycle, uint32_t lookups, double maxSlowdown) {
+    uint32_t routes = gw->GetNUnicastRoutes();
+    uint32_t entries = gw->GetRoutingTableEntries().size();
+
+    Ipv4Address hello("230.0.0.30");
+    uint32_t hits = 0;
+    SystemWallClockMs clock;
+    clock.Start();
+    for (uint32_t n = 0; n < lookups; n++) {
+        hits += gw->HasUnicastRoute(hello);
+    }
+    double nsPerLookup = clock.End() * 1e6 / lookups;
+
+    std::cout << std::setw(10) << cycle << std::setw(10) << routes << std::setw(10) << entries
+            << std::setw(16) << std::fixed << std::setprecision(1) << nsPerLookup << std::endl;
+    NS_ABORT_MSG_UNLESS(hits == lookups, "the HELLO route is missing after cycle " << cycle);
+    if (!first->taken) {
+        first->taken = true;
+        first->routes = routes;
+        first->entries = entries;
+        first->nsPerLookup = nsPerLookup;
+    }
+    NS_ABORT_MSG_UNLESS(routes == first->routes, "unicast routes grew to " << routes << " after cycle " << cycle);
+    NS_ABORT_MSG_UNLESS(entries == first->entries, "forwarding entries grew to " << entries << " after cycle " << cycle);
+    // The wall clock counts in ms, so a first sample under one tick is taken as one tick.
+    double baseline = std::max(first->nsPerLookup, 1e6 / lookups);
+    NS_ABORT_MSG_UNLESS(nsPerLookup <= maxSlowdown * baseline, "a lookup costs " << nsPerLookup
+            << " ns after cycle " << cycle << ", " << first->nsPerLookup << " ns in the first sample");
+}
+
+int
+main(int argc, char *argv[]) {
+    uint32_t cycles = 5000;
+    uint32_t sampleEvery = 500;
+    uint32_t lookups = 1000000;
+    double maxSlowdown = 3;
+
+    CommandLine cmd;
+    cmd.AddValue("cycles", "Number of DoStop/DoStart cycles", cycles);
+    cmd.AddValue("sampleEvery", "Cycles between two samples", sampleEvery);
+    cmd.AddValue("lookups", "Route lookups timed per sample", lookups);
+    cmd.AddValue("maxSlowdown", "Lookup cost allowed, as a multiple of the first sample", maxSlowdown);
+    cmd.Parse(argc, argv);
+
+    Ipv4Address group("225.1.2.4");
+    NodeContainer source;
+    source.Create(1);
+    NodeContainer gateways;
+    gateways.Create(2);
+
+    SimpleNetDeviceHelper simple;
+    NetDeviceContainer lan = simple.Install(NodeContainer(source, gateways));
+    NetDeviceContainer manet = simple.Install(gateways);
+
+    AimfHelper aimf;
+    for (uint32_t i = 0; i < gateways.GetN(); i++) {
+        aimf.ExcludeInterface(gateways.Get(i), 2);
+        aimf.SetMANETNetDeviceID(gateways.Get(i), 2);
+    }
+    Ipv4StaticRoutingHelper staticRouting;
+    Ipv4ListRoutingHelper list;
+    list.Add(staticRouting, 0);
+    list.Add(aimf, 10);
+
+    InternetStackHelper internet;
+    internet.Install(source);
+    InternetStackHelper gatewayInternet;
+    gatewayInternet.SetRoutingHelper(list);
+    gatewayInternet.Install(gateways);
+
+    Ipv4AddressHelper ipv4;
+    ipv4.SetBase("10.1.1.0", "255.255.255.0");
+    Ipv4InterfaceContainer lanAddresses = ipv4.Assign(lan);
+    ipv4.SetBase("10.1.2.0", "255.255.255.0");
+    ipv4.Assign(manet);
+
+    for (uint32_t i = 0; i < gateways.GetN(); i++) {
+        Simulator::Schedule(Seconds(1), &aimf::RoutingProtocol::AddHostMulticastAssociation,
+                gateways.Get(i)->GetObject<aimf::RoutingProtocol> (), group, lanAddresses.GetAddress(0));
+    }
+
+    Ptr<aimf::RoutingProtocol> gw0 = gateways.Get(0)->GetObject<aimf::RoutingProtocol> ();
+    SoakSample first = {false, 0, 0, 0};
+    Time begin = Seconds(10);
+    for (uint32_t i = 0; i < cycles; i++) {
+        Time t = begin + MilliSeconds(100 * (uint64_t) i);
+        Simulator::Schedule(t, &aimf::RoutingProtocol::DoStop, gw0);
+        Simulator::Schedule(t + MilliSeconds(50), &aimf::RoutingProtocol::DoStart, gw0);
+        if (i % sampleEvery == 0 || i == cycles - 1) {
+            // Between two cycles, with gw0 running.
+            Simulator::Schedule(t + MilliSeconds(75), &Sample, gw0, &first, i + 1, lookups, maxSlowdown);
+        }
+    }
+
+    std::cout << std::setw(10) << "cycle" << std::setw(10) << "routes" << std::setw(10) << "entries"
+            << std::setw(16) << "lookup ns/op" << std::endl;
+    Simulator::Stop(begin + MilliSeconds(100 * (uint64_t) cycles) + Seconds(1));
+    Simulator::Run();
+    Simulator::Destroy();
+    return 0;
+}
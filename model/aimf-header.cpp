@@ -1,13 +1,22 @@
+#include <algorithm>
 #include <cmath>
 
 #include "ns3/assert.h"
 #include "ns3/log.h"
 
 #include "aimf-header.h"
+#include "aimf-repository.h"
 
-#define IPV4_ADDRESS_SIZE 5
+#define IPV4_ADDRESS_SIZE 4
 #define AIMF_MSG_HEADER_SIZE 11
 #define AIMF_PKT_HEADER_SIZE 4
+#define AIMF_HELLO_HEADER_SIZE 8
+#define AIMF_RESYNC_HEADER_SIZE 8
+// Group, source and will, a range of groups adds its prefix length.
+#define AIMF_HELLO_ASSOCIATION_SIZE (2 * IPV4_ADDRESS_SIZE + 1)
+#define AIMF_HELLO_PREFIX_SIZE 1
+// Set in the will byte of a record followed by a prefix length.
+#define AIMF_HELLO_PREFIX_FLAG 0x80
 
 namespace ns3 {
 
@@ -119,6 +128,9 @@ namespace ns3 {
         uint32_t
         PacketHeader::Deserialize(Buffer::Iterator start) {
             Buffer::Iterator i = start;
+            if (i.GetRemainingSize() < AIMF_PKT_HEADER_SIZE) {
+                return 0;
+            }
             m_packetLength = i.ReadNtohU16();
             m_packetSequenceNumber = i.ReadNtohU16();
             return GetSerializedSize();
@@ -155,8 +167,20 @@ namespace ns3 {
         MessageHeader::GetSerializedSize(void) const {
             uint32_t size = AIMF_MSG_HEADER_SIZE;
 
-            NS_LOG_DEBUG("Hello Message Size: " << size << " + " << m_message.hello.GetSerializedSize());
-            size += m_message.hello.GetSerializedSize();
+            switch (m_messageType) {
+                case HELLO_MESSAGE:
+                    NS_LOG_DEBUG("Hello Message Size: " << size << " + " << m_message.hello.GetSerializedSize());
+                    size += m_message.hello.GetSerializedSize();
+                    break;
+                case RESYNC_MESSAGE:
+                    size += m_message.resync.GetSerializedSize();
+                    break;
+                case GOODBYE_MESSAGE:
+                    size += m_message.goodbye.GetSerializedSize();
+                    break;
+                default:
+                    NS_ASSERT(false);
+            }
 
             return size;
         }
@@ -175,7 +199,19 @@ namespace ns3 {
             i.WriteHtonU32(m_originatorAddress.Get());
             i.WriteU8(m_timeToLive);
             i.WriteHtonU16(m_messageSequenceNumber);
-            m_message.hello.Serialize(i);
+            switch (m_messageType) {
+                case HELLO_MESSAGE:
+                    m_message.hello.Serialize(i);
+                    break;
+                case RESYNC_MESSAGE:
+                    m_message.resync.Serialize(i);
+                    break;
+                case GOODBYE_MESSAGE:
+                    m_message.goodbye.Serialize(i);
+                    break;
+                default:
+                    NS_ASSERT(false);
+            }
 
 
         }
@@ -184,26 +220,49 @@ namespace ns3 {
         MessageHeader::Deserialize(Buffer::Iterator start) {
             uint32_t size;
             Buffer::Iterator i = start;
+            uint32_t remaining = i.GetRemainingSize();
+            if (remaining < AIMF_MSG_HEADER_SIZE) {
+                return 0;
+            }
             m_messageType = (MessageType) i.ReadU8();
-            NS_ASSERT(m_messageType == HELLO_MESSAGE);
             m_vTime = i.ReadU8();
             m_messageSize = i.ReadNtohU16();
             m_originatorAddress = Ipv4Address(i.ReadNtohU32());
             m_timeToLive = i.ReadU8();            
             m_messageSequenceNumber = i.ReadNtohU16();
-            size = AIMF_MSG_HEADER_SIZE;
+            if (m_messageSize < AIMF_MSG_HEADER_SIZE || m_messageSize > remaining) {
+                return 0;
+            }
 
-            size += m_message.hello.Deserialize(i, m_messageSize - AIMF_MSG_HEADER_SIZE);
+            switch (m_messageType) {
+                case HELLO_MESSAGE:
+                    size = m_message.hello.Deserialize(i, m_messageSize - AIMF_MSG_HEADER_SIZE);
+                    break;
+                case RESYNC_MESSAGE:
+                    size = m_message.resync.Deserialize(i, m_messageSize - AIMF_MSG_HEADER_SIZE);
+                    break;
+                case GOODBYE_MESSAGE:
+                    size = m_message.goodbye.Deserialize(i, m_messageSize - AIMF_MSG_HEADER_SIZE);
+                    break;
+                default:
+                    return 0;
+            }
 
-            return size;
+            // A body that does not fill its message leaves nothing to skip to.
+            return size == 0 ? 0 : AIMF_MSG_HEADER_SIZE + size;
         }
 
         // ---------------- AIMF HELLO Message -------------------------------
 
         uint32_t
         MessageHeader::Hello::GetSerializedSize(void) const {
-            uint32_t size = 2;
-            size += 2 * this->associations.size() * IPV4_ADDRESS_SIZE;
+            uint32_t size = AIMF_HELLO_HEADER_SIZE;
+            for (size_t n = 0; n < this->associations.size(); ++n) {
+                size += AIMF_HELLO_ASSOCIATION_SIZE;
+                if (this->associations[n].groupPrefixLength != AIMF_SINGLE_GROUP_PREFIX) {
+                    size += AIMF_HELLO_PREFIX_SIZE;
+                }
+            }
             return size;
         }
 
@@ -219,45 +278,398 @@ namespace ns3 {
 
             i.WriteU8(this->hTime);
             i.WriteU8(this->willingness);
-            
+            i.WriteHtonU16(this->ansn);
+            i.WriteU8(this->flags);
+            i.WriteU8(0); // Reserved
+            i.WriteU8(this->fragment);
+            i.WriteU8(this->fragments);
 
             for (size_t n = 0; n < this->associations.size(); ++n) {
                 i.WriteHtonU32(this->associations[n].group.Get());
                 i.WriteHtonU32(this->associations[n].source.Get());
-                i.WriteU8(this->associations[n].willGroupSSM);
+                uint8_t will = this->associations[n].willGroupSSM & ~AIMF_HELLO_PREFIX_FLAG;
+                if (this->associations[n].groupPrefixLength == AIMF_SINGLE_GROUP_PREFIX) {
+                    i.WriteU8(will);
+                } else {
+                    i.WriteU8(will | AIMF_HELLO_PREFIX_FLAG);
+                    i.WriteU8(this->associations[n].groupPrefixLength);
+                }
             }
         }
 
         uint32_t
         MessageHeader::Hello::Deserialize(Buffer::Iterator start, uint32_t messageSize) {
             Buffer::Iterator i = start;
-
-
-            
+            this->associations.clear();
+            if (messageSize < AIMF_HELLO_HEADER_SIZE) {
+                return 0;
+            }
             this->hTime = i.ReadU8();
             this->willingness = i.ReadU8();
-            
-        
-
-            NS_ASSERT((messageSize-2) % (IPV4_ADDRESS_SIZE * 2) == 0);
-            int numAddresses = (messageSize-2) / IPV4_ADDRESS_SIZE / 2;
-            this->associations.clear();
-            for (int n = 0; n < numAddresses; ++n) {
+            this->ansn = i.ReadNtohU16();
+            this->flags = i.ReadU8();
+            i.ReadU8(); // Reserved
+            this->fragment = i.ReadU8();
+            this->fragments = i.ReadU8();
+
+            uint32_t left = messageSize - AIMF_HELLO_HEADER_SIZE;
+            while (left > 0) {
+                if (left < AIMF_HELLO_ASSOCIATION_SIZE) {
+                    this->associations.clear();
+                    return 0;
+                }
                 Ipv4Address group(i.ReadNtohU32());
                 Ipv4Address source(i.ReadNtohU32());
                 uint8_t will(i.ReadU8());
+                uint8_t groupPrefixLength = AIMF_SINGLE_GROUP_PREFIX;
+                left -= AIMF_HELLO_ASSOCIATION_SIZE;
+                if (will & AIMF_HELLO_PREFIX_FLAG) {
+                    if (left < AIMF_HELLO_PREFIX_SIZE) {
+                        this->associations.clear();
+                        return 0;
+                    }
+                    groupPrefixLength = i.ReadU8();
+                    left -= AIMF_HELLO_PREFIX_SIZE;
+                }
                 this->associations.push_back((Association) {
-                    group, source, will
+                    group, groupPrefixLength, source, (uint8_t) (will & ~AIMF_HELLO_PREFIX_FLAG)
                 });
             }
 
+            return messageSize;
+        }
+
+        // ---------------- AIMF RESYNC Message -------------------------------
+
+        uint32_t
+        MessageHeader::Resync::GetSerializedSize(void) const {
+            return AIMF_RESYNC_HEADER_SIZE + this->missing.size();
+        }
+
+        void
+        MessageHeader::Resync::Print(std::ostream &os) const {
+            /// \todo
+        }
+
+        void
+        MessageHeader::Resync::Serialize(Buffer::Iterator start) const {
+            Buffer::Iterator i = start;
+            i.WriteHtonU32(this->target.Get());
+            i.WriteHtonU16(this->ansn);
+            i.WriteU8(this->fragments);
+            i.WriteU8(0); // Reserved
+            for (size_t n = 0; n < this->missing.size(); ++n) {
+                i.WriteU8(this->missing[n]);
+            }
+        }
+
+        uint32_t
+        MessageHeader::Resync::Deserialize(Buffer::Iterator start, uint32_t messageSize) {
+            Buffer::Iterator i = start;
+            this->missing.clear();
+            if (messageSize < AIMF_RESYNC_HEADER_SIZE) {
+                return 0;
+            }
+            this->target = Ipv4Address(i.ReadNtohU32());
+            this->ansn = i.ReadNtohU16();
+            this->fragments = i.ReadU8();
+            i.ReadU8(); // Reserved
+            for (uint32_t n = AIMF_RESYNC_HEADER_SIZE; n < messageSize; ++n) {
+                this->missing.push_back(i.ReadU8());
+            }
+            return messageSize;
+        }
+
+        // ---------------- AIMF GOODBYE Message -------------------------------
 
+        uint32_t
+        MessageHeader::Goodbye::GetSerializedSize(void) const {
+            return 2;
+        }
+
+        void
+        MessageHeader::Goodbye::Print(std::ostream &os) const {
+            /// \todo
+        }
+
+        void
+        MessageHeader::Goodbye::Serialize(Buffer::Iterator start) const {
+            Buffer::Iterator i = start;
+            i.WriteU8(this->willingness);
+            i.WriteU8(this->flags);
+        }
+
+        uint32_t
+        MessageHeader::Goodbye::Deserialize(Buffer::Iterator start, uint32_t messageSize) {
+            Buffer::Iterator i = start;
+            if (messageSize != GetSerializedSize()) {
+                return 0;
+            }
+            this->willingness = i.ReadU8();
+            this->flags = i.ReadU8();
             return messageSize;
         }
 
+        // ---------------- AIMF packet reader -------------------------------
 
+        static inline uint16_t
+        ReadU16(const uint8_t *p) {
+            return (uint16_t) ((p[0] << 8) | p[1]);
+        }
 
-        
+        static inline uint32_t
+        ReadU32(const uint8_t *p) {
+            return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+        }
+
+        static inline void
+        WriteU16(uint8_t *p, uint16_t value) {
+            p[0] = (uint8_t) (value >> 8);
+            p[1] = (uint8_t) value;
+        }
+
+        static inline void
+        WriteU32(uint8_t *p, uint32_t value) {
+            WriteU16(p, (uint16_t) (value >> 16));
+            WriteU16(p + 2, (uint16_t) value);
+        }
+
+        static inline uint32_t
+        RecordSize(const uint8_t *record) {
+            return (record[2 * IPV4_ADDRESS_SIZE] & AIMF_HELLO_PREFIX_FLAG)
+                    ? AIMF_HELLO_ASSOCIATION_SIZE + AIMF_HELLO_PREFIX_SIZE : AIMF_HELLO_ASSOCIATION_SIZE;
+        }
+
+        MessageHeader::Hello::Association
+        HelloView::ReadAssociation(uint32_t &offset) const {
+            const uint8_t *record = this->records + offset;
+            uint8_t will = record[2 * IPV4_ADDRESS_SIZE];
+            MessageHeader::Hello::Association association = {
+                Ipv4Address(ReadU32(record)),
+                (will & AIMF_HELLO_PREFIX_FLAG) ? record[AIMF_HELLO_ASSOCIATION_SIZE] : (uint8_t) AIMF_SINGLE_GROUP_PREFIX,
+                Ipv4Address(ReadU32(record + IPV4_ADDRESS_SIZE)),
+                (uint8_t) (will & ~AIMF_HELLO_PREFIX_FLAG)
+            };
+            offset += RecordSize(record);
+            return association;
+        }
+
+        PacketReader::PacketReader(const uint8_t *data, uint32_t size)
+        : m_data(data),
+        m_end(0),
+        m_offset(AIMF_PKT_HEADER_SIZE),
+        m_packetSequenceNumber(0),
+        m_malformed(true) {
+            if (size < AIMF_PKT_HEADER_SIZE) {
+                return;
+            }
+            uint16_t length = ReadU16(data);
+            if (length < AIMF_PKT_HEADER_SIZE || length > size) {
+                return;
+            }
+            m_end = length;
+            m_packetSequenceNumber = ReadU16(data + 2);
+            m_malformed = false;
+        }
+
+        bool
+        PacketReader::Next(MessageView &message) {
+            if (m_malformed || m_offset == m_end) {
+                return false;
+            }
+            uint32_t left = m_end - m_offset;
+            const uint8_t *p = m_data + m_offset;
+            uint16_t size = left < AIMF_MSG_HEADER_SIZE ? 0 : ReadU16(p + 2);
+            if (size < AIMF_MSG_HEADER_SIZE || size > left) {
+                m_malformed = true;
+                return false;
+            }
+            message.messageType = p[0];
+            message.vTime = p[1];
+            message.originatorAddress = Ipv4Address(ReadU32(p + 4));
+            message.timeToLive = p[8];
+            message.messageSequenceNumber = ReadU16(p + 9);
+            message.body = p + AIMF_MSG_HEADER_SIZE;
+            message.bodySize = size - AIMF_MSG_HEADER_SIZE;
+            m_offset += size;
+            return true;
+        }
+
+        bool
+        PacketReader::ReadHello(const MessageView &message, HelloView &hello) {
+            NS_ASSERT(message.messageType == MessageHeader::HELLO_MESSAGE);
+            if (message.bodySize < AIMF_HELLO_HEADER_SIZE) {
+                return false;
+            }
+            const uint8_t *p = message.body;
+            hello.hTime = p[0];
+            hello.willingness = p[1];
+            hello.ansn = ReadU16(p + 2);
+            hello.flags = p[4];
+            hello.fragment = p[6];
+            hello.fragments = p[7];
+            if (hello.fragment >= hello.fragments) {
+                return false;
+            }
+            hello.records = p + AIMF_HELLO_HEADER_SIZE;
+            hello.nAssociations = 0;
+            // Every record must fit the body, only a prefix length can be out
+            // of range, and the group must not have bits past it.
+            uint32_t left = message.bodySize - AIMF_HELLO_HEADER_SIZE;
+            const uint8_t *record = hello.records;
+            while (left > 0) {
+                if (left < AIMF_HELLO_ASSOCIATION_SIZE || left < RecordSize(record)) {
+                    return false;
+                }
+                if (record[2 * IPV4_ADDRESS_SIZE] & AIMF_HELLO_PREFIX_FLAG) {
+                    uint8_t length = record[AIMF_HELLO_ASSOCIATION_SIZE];
+                    if (length > AIMF_SINGLE_GROUP_PREFIX || (ReadU32(record) & ~GroupPrefixMask(length)) != 0) {
+                        return false;
+                    }
+                }
+                left -= RecordSize(record);
+                record += RecordSize(record);
+                hello.nAssociations++;
+            }
+            return true;
+        }
+
+        bool
+        PacketReader::ReadResync(const MessageView &message, MessageHeader::Resync &resync) {
+            NS_ASSERT(message.messageType == MessageHeader::RESYNC_MESSAGE);
+            if (message.bodySize < AIMF_RESYNC_HEADER_SIZE) {
+                return false;
+            }
+            const uint8_t *p = message.body;
+            resync.target = Ipv4Address(ReadU32(p));
+            resync.ansn = ReadU16(p + 4);
+            resync.fragments = p[6];
+            resync.missing.assign(p + AIMF_RESYNC_HEADER_SIZE, p + message.bodySize);
+            if (resync.IsWholeSet() != resync.missing.empty()) {
+                return false;
+            }
+            for (size_t n = 0; n < resync.missing.size(); n++) {
+                if (resync.missing[n] >= resync.fragments) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        bool
+        PacketReader::ReadGoodbye(const MessageView &message, MessageHeader::Goodbye &goodbye) {
+            NS_ASSERT(message.messageType == MessageHeader::GOODBYE_MESSAGE);
+            if (message.bodySize != goodbye.GetSerializedSize()) {
+                return false;
+            }
+            goodbye.willingness = message.body[0];
+            goodbye.flags = message.body[1];
+            return true;
+        }
+
+        // ---------------- AIMF HELLO template -------------------------------
+
+        HelloTemplate::HelloTemplate()
+        : m_nAssociations(0),
+        m_splitSize(0) {
+        }
+
+        void
+        HelloTemplate::ClearAssociations() {
+            m_records.clear();
+            m_nAssociations = 0;
+            m_fragmentOffsets.clear();
+        }
+
+        void
+        HelloTemplate::AddAssociation(const MessageHeader::Hello::Association &association) {
+            uint32_t offset = m_records.size();
+            bool range = association.groupPrefixLength != AIMF_SINGLE_GROUP_PREFIX;
+            m_records.resize(offset + AIMF_HELLO_ASSOCIATION_SIZE + (range ? AIMF_HELLO_PREFIX_SIZE : 0));
+            uint8_t *record = &m_records[offset];
+            WriteU32(record, association.group.Get());
+            WriteU32(record + IPV4_ADDRESS_SIZE, association.source.Get());
+            record[2 * IPV4_ADDRESS_SIZE] = association.willGroupSSM & ~AIMF_HELLO_PREFIX_FLAG;
+            if (range) {
+                record[2 * IPV4_ADDRESS_SIZE] |= AIMF_HELLO_PREFIX_FLAG;
+                record[AIMF_HELLO_ASSOCIATION_SIZE] = association.groupPrefixLength;
+            }
+            m_nAssociations++;
+            m_fragmentOffsets.clear();
+        }
+
+        uint32_t
+        HelloTemplate::GetNAssociations() const {
+            return m_nAssociations;
+        }
+
+        void
+        HelloTemplate::Split(uint32_t maxSize) const {
+            if (!m_fragmentOffsets.empty() && m_splitSize == maxSize) {
+                return;
+            }
+            uint32_t budget = 0;
+            if (maxSize > AIMF_MSG_HEADER_SIZE + AIMF_HELLO_HEADER_SIZE) {
+                budget = maxSize - AIMF_MSG_HEADER_SIZE - AIMF_HELLO_HEADER_SIZE;
+            }
+            // At least one record each, and the fragment fields are one
+            // byte: every fragment but the last is filled past m_records / 254.
+            budget = std::max<uint32_t> (budget, m_records.size() / 254
+                    + AIMF_HELLO_ASSOCIATION_SIZE + AIMF_HELLO_PREFIX_SIZE);
+            m_fragmentOffsets.assign(1, 0);
+            uint32_t offset = 0;
+            while (offset < m_records.size()) {
+                uint32_t size = RecordSize(&m_records[offset]);
+                if (offset + size - m_fragmentOffsets.back() > budget) {
+                    m_fragmentOffsets.push_back(offset);
+                }
+                offset += size;
+            }
+            m_fragmentOffsets.push_back(m_records.size());
+            m_splitSize = maxSize;
+        }
+
+        uint8_t
+        HelloTemplate::GetNFragments(uint32_t maxSize) const {
+            Split(maxSize);
+            return m_fragmentOffsets.size() - 1;
+        }
+
+        uint32_t
+        HelloTemplate::AppendMessage(const MessageHeader &msg, uint32_t maxSize, std::vector<uint8_t> &out) const {
+            const MessageHeader::Hello &hello = msg.GetHello();
+            NS_ASSERT(hello.associations.empty());
+            uint32_t first = 0;
+            uint32_t end = 0;
+            if (hello.IsFull()) {
+                NS_ASSERT(hello.fragments == GetNFragments(maxSize) && hello.fragment < hello.fragments);
+                first = m_fragmentOffsets[hello.fragment];
+                end = m_fragmentOffsets[hello.fragment + 1];
+            }
+            uint32_t size = AIMF_MSG_HEADER_SIZE + AIMF_HELLO_HEADER_SIZE + end - first;
+            NS_ASSERT(size <= 0xffff);
+            uint32_t offset = out.size();
+            out.resize(offset + size);
+            uint8_t *p = &out[offset];
+            p[0] = MessageHeader::HELLO_MESSAGE;
+            p[1] = SecondsToEmf(msg.GetVTime().GetSeconds());
+            WriteU16(p + 2, size);
+            WriteU32(p + 4, msg.GetOriginatorAddress().Get());
+            p[8] = msg.GetTimeToLive();
+            WriteU16(p + 9, msg.GetMessageSequenceNumber());
+            p += AIMF_MSG_HEADER_SIZE;
+            p[0] = hello.hTime;
+            p[1] = hello.willingness;
+            WriteU16(p + 2, hello.ansn);
+            p[4] = hello.flags;
+            p[5] = 0; // Reserved
+            p[6] = hello.fragment;
+            p[7] = hello.fragments;
+            if (end > first) {
+                std::copy(m_records.begin() + first, m_records.begin() + end, p + AIMF_HELLO_HEADER_SIZE);
+            }
+            return size;
+        }
 
     }
 } // namespace aimf, ns3
@@ -91,6 +91,8 @@ namespace ns3 {
 
             enum MessageType {
                 HELLO_MESSAGE = 1,
+                RESYNC_MESSAGE = 2,
+                GOODBYE_MESSAGE = 3,
             };
 
             MessageHeader();
@@ -151,6 +153,8 @@ namespace ns3 {
             virtual void Print(std::ostream &os) const;
             virtual uint32_t GetSerializedSize(void) const;
             virtual void Serialize(Buffer::Iterator start) const;
+            /// \return the size of the message, or 0 if it is malformed or
+            /// runs past the buffer
             virtual uint32_t Deserialize(Buffer::Iterator start);
 
            
@@ -160,8 +164,10 @@ namespace ns3 {
             //        0                   1                   2                   3                   
             //        0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 
             //
-            //       +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
-            //       |     Htime     |  Willingness  | 
+            //       +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+            //       |     Htime     |  Willingness  |             ANSN              |
+            //       +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+            //       |     Flags     |   Reserved    |   Fragment    |   Fragments   |
             //       +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
             //       |                              HMA1                             |                                                           |
             //       +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
@@ -197,7 +203,9 @@ namespace ns3 {
             struct Hello {
 
                 struct Association {
+                    /// First group of the range with groupPrefixLength below 32.
                     Ipv4Address group;
+                    uint8_t groupPrefixLength;
                     Ipv4Address source;
                     uint8_t willGroupSSM;
                 };
@@ -212,12 +220,29 @@ namespace ns3 {
                     return Seconds(EmfToSeconds(this->hTime));
                 }
 
+                /// The message carries the complete association set of the
+                /// originator for ansn. Without it the HELLO only refreshes the
+                /// neighbor and tells which ANSN is current.
+                static const uint8_t FULL = 0x01;
+
                 uint8_t willingness;
+                /// Advertised association set sequence number.
+                uint16_t ansn;
+                uint8_t flags;
+                /// A FULL association set too large for one message is split
+                /// over fragments HELLOs, this one is number fragment from 0.
+                uint8_t fragment;
+                uint8_t fragments;
                 std::vector<Association> associations;
 
+                bool IsFull() const {
+                    return (flags & FULL) != 0;
+                }
+
                 void Print(std::ostream &os) const;
                 uint32_t GetSerializedSize(void) const;
                 void Serialize(Buffer::Iterator start) const;
+                /// \return messageSize, or 0 if the records do not fill it exactly
                 uint32_t Deserialize(Buffer::Iterator start, uint32_t messageSize);
             };
 
@@ -236,18 +261,93 @@ namespace ns3 {
             //       +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
             //       |                         Source Address                        |
             //       +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
-            //       |       will     |
+            //       |P|    will     |
             //       +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
             //       |                         Group Address                         |
             //       +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
             //       |                         Source Address                        |
             //       +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
-            //       |       will     |
+            //       |P|    will     | Prefix Length |
             //       +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
             //       |                              ...                              |
             //       +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
 
             // Note: HMA stands for Host multicast Association
+            //
+            // A record for one group is 9 bytes. A record for a range of
+            // groups has P set and a Prefix Length byte, the number of
+            // leading bits of Group Address that it covers. A gateway
+            // serving 225.1.0.0/16 sends one record instead of 65536. A will
+            // above 7 inherits the willingness of the gateway.
+
+
+            // RESYNC Message Format
+            //
+            //    Asks the target for its full association set, sent by a node
+            //    that missed an ANSN change of the target. A node that received
+            //    part of the fragments of the set names the ANSN, the number of
+            //    fragments and the ones it misses, and only those are sent
+            //    again. Fragments 0 asks for the whole set.
+            //
+            //        0                   1                   2                   3
+            //        0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+            //       +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+            //       |                         Target Address                        |
+            //       +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+            //       |             ANSN              |   Fragments   |   Reserved    |
+            //       +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+            //       |   Missing 1   |   Missing 2   |              ...
+            //       +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+
+            struct Resync {
+                Ipv4Address target;
+                uint16_t ansn;
+                uint8_t fragments;
+                /// Fragment numbers, below fragments.
+                std::vector<uint8_t> missing;
+
+                bool IsWholeSet() const {
+                    return fragments == 0;
+                }
+
+                void Print(std::ostream &os) const;
+                uint32_t GetSerializedSize(void) const;
+                void Serialize(Buffer::Iterator start) const;
+                /// \return messageSize, or 0 if it is shorter than the fixed fields
+                uint32_t Deserialize(Buffer::Iterator start, uint32_t messageSize);
+            };
+
+
+            // GOODBYE Message Format
+            //
+            //    Sent right away when the originator stops AIMF (WITHDRAW) or
+            //    lowers its willingness, so that the neighbors rerun their
+            //    election without waiting for the neighbor hold time.
+            //
+            //        0                   1
+            //        0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5
+            //       +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+            //       |  Willingness  |     Flags     |
+            //       +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+
+            struct Goodbye {
+                /// The originator is leaving, drop it as neighbor.
+                static const uint8_t WITHDRAW = 0x01;
+
+                /// New willingness of the originator.
+                uint8_t willingness;
+                uint8_t flags;
+
+                bool IsWithdraw() const {
+                    return (flags & WITHDRAW) != 0;
+                }
+
+                void Print(std::ostream &os) const;
+                uint32_t GetSerializedSize(void) const;
+                void Serialize(Buffer::Iterator start) const;
+                /// \return messageSize, or 0 if it is not the size of a GOODBYE
+                uint32_t Deserialize(Buffer::Iterator start, uint32_t messageSize);
+            };
 
 
 
@@ -255,7 +355,8 @@ namespace ns3 {
 
             struct {
                 Hello hello;
-
+                Resync resync;
+                Goodbye goodbye;
             } m_message; // union not allowed
 
         public:
@@ -274,9 +375,159 @@ namespace ns3 {
                 return m_message.hello;
             }
 
+            Resync& GetResync() {
+                if (m_messageType == 0) {
+                    m_messageType = RESYNC_MESSAGE;
+                } else {
+                    NS_ASSERT(m_messageType == RESYNC_MESSAGE);
+                }
+                return m_message.resync;
+            }
 
+            const Resync& GetResync() const {
+                NS_ASSERT(m_messageType == RESYNC_MESSAGE);
+                return m_message.resync;
+            }
 
+            Goodbye& GetGoodbye() {
+                if (m_messageType == 0) {
+                    m_messageType = GOODBYE_MESSAGE;
+                } else {
+                    NS_ASSERT(m_messageType == GOODBYE_MESSAGE);
+                }
+                return m_message.goodbye;
+            }
+
+            const Goodbye& GetGoodbye() const {
+                NS_ASSERT(m_messageType == GOODBYE_MESSAGE);
+                return m_message.goodbye;
+            }
+
+
+
+
+        };
+
+        /// One message of a received packet, read in place by PacketReader.
+        ///
+        /// The body is not copied out of the packet bytes, so a view is only
+        /// valid as long as the buffer it was read from.
+
+        struct MessageView {
+            uint8_t messageType;
+            uint8_t vTime;
+            Ipv4Address originatorAddress;
+            uint8_t timeToLive;
+            uint16_t messageSequenceNumber;
+            const uint8_t *body;
+            uint16_t bodySize;
+
+            Time GetVTime() const {
+                return Seconds(EmfToSeconds(this->vTime));
+            }
+        };
+
+        /// The fixed fields of a HELLO and its association records, which
+        /// are decoded one at a time from the packet bytes on request.
+
+        struct HelloView {
+            uint8_t hTime;
+            uint8_t willingness;
+            uint16_t ansn;
+            uint8_t flags;
+            uint8_t fragment;
+            uint8_t fragments;
+            const uint8_t *records;
+            uint32_t nAssociations;
+
+            Time GetHTime() const {
+                return Seconds(EmfToSeconds(this->hTime));
+            }
+
+            bool IsFull() const {
+                return (flags & MessageHeader::Hello::FULL) != 0;
+            }
+
+            /// Decode the record offset bytes into the records and move offset
+            /// past it. Records differ in size, read them in order from 0.
+            MessageHeader::Hello::Association ReadAssociation(uint32_t &offset) const;
+        };
 
+        /// Walks the messages of a received AIMF packet in one pass.
+        ///
+        /// Every length is checked against the bytes that are left before it
+        /// is used, a packet that does not add up is reported through
+        /// IsMalformed() instead of asserting. Nothing is allocated.
+
+        class PacketReader {
+        public:
+            /// Reads the packet header of the size bytes at data.
+            PacketReader(const uint8_t *data, uint32_t size);
+
+            /// Read the next message header.
+            /// \return false at the end of the packet, or if the message is malformed
+            bool Next(MessageView &message);
+
+            /// The packet header or one of the messages read so far is malformed.
+            bool IsMalformed() const {
+                return m_malformed;
+            }
+
+            uint16_t GetPacketSequenceNumber() const {
+                return m_packetSequenceNumber;
+            }
+
+            /// Read the body of a message of the matching type.
+            /// \return false if the body does not have the size of its type
+            static bool ReadHello(const MessageView &message, HelloView &hello);
+            static bool ReadResync(const MessageView &message, MessageHeader::Resync &resync);
+            static bool ReadGoodbye(const MessageView &message, MessageHeader::Goodbye &goodbye);
+
+        private:
+            const uint8_t *m_data;
+            uint32_t m_end;
+            uint32_t m_offset;
+            uint16_t m_packetSequenceNumber;
+            bool m_malformed;
+        };
+
+        /// A HELLO kept serialized between sends.
+        ///
+        /// The association records are written once, when the association
+        /// set changes. Each send only writes the header fields in front of
+        /// them, split into fragments that fit the given message size.
+
+        class HelloTemplate {
+        public:
+            HelloTemplate();
+
+            /// Drop the association records.
+            void ClearAssociations();
+            void AddAssociation(const MessageHeader::Hello::Association &association);
+            uint32_t GetNAssociations() const;
+
+            /// Number of HELLOs of at most maxSize bytes the records need, at
+            /// least 1 and at most 255. Past 255 the messages grow beyond maxSize.
+            uint8_t GetNFragments(uint32_t maxSize) const;
+
+            /// Append a HELLO to out: the header fields of msg, a HELLO
+            /// without associations of its own, and with FULL in its flags the
+            /// records of its fragment, as split by GetNFragments(maxSize).
+            /// \return the size of the message
+            uint32_t AppendMessage(const MessageHeader &msg, uint32_t maxSize, std::vector<uint8_t> &out) const;
+
+        private:
+            /// Split the records into fragments for maxSize, unless they
+            /// already are.
+            void Split(uint32_t maxSize) const;
+
+            std::vector<uint8_t> m_records;
+            uint32_t m_nAssociations;
+            /// Offset of the first record of each fragment, then the end of
+            /// the records, for HELLOs of at most m_splitSize bytes. An empty
+            /// vector until the records are split.
+            mutable std::vector<uint32_t> m_fragmentOffsets;
+            mutable uint32_t m_splitSize;
         };
 
         static inline std::ostream& operator<<(std::ostream& os, const PacketHeader & packet) {
@@ -0,0 +1,118 @@
+/*
+ * File:   aimf-lpm-table.cpp
+ * Author: debonatis
+ *
+ * Longest prefix match table for the unicast routes of AIMF.
+ */
+
+#include "aimf-lpm-table.h"
+#include "ns3/ipv4.h"
+
+namespace ns3 {
+    namespace aimf {
+
+        LpmTable::LpmTable() {
+            Clear();
+        }
+
+        void
+        LpmTable::Clear() {
+            m_nodes.clear();
+            Node root;
+            root.child[0] = root.child[1] = 0;
+            m_nodes.push_back(root);
+            m_nRoutes = 0;
+        }
+
+        uint32_t
+        LpmTable::GetNRoutes() const {
+            return m_nRoutes;
+        }
+
+        uint32_t
+        LpmTable::FindNode(uint32_t prefix, uint16_t length, bool create) {
+            uint32_t node = 0;
+            for (uint16_t depth = 0; depth < length; depth++) {
+                uint32_t bit = (prefix >> (31 - depth)) & 1;
+                uint32_t next = m_nodes[node].child[bit];
+                if (next == 0) {
+                    if (!create) {
+                        return 0;
+                    }
+                    Node child;
+                    child.child[0] = child.child[1] = 0;
+                    next = m_nodes.size();
+                    // push_back may move the nodes, so index again afterwards.
+                    m_nodes.push_back(child);
+                    m_nodes[node].child[bit] = next;
+                }
+                node = next;
+            }
+            return node;
+        }
+
+        void
+        LpmTable::Insert(const Ipv4RoutingTableEntry &entry, uint32_t metric) {
+            Ipv4Mask mask = entry.GetDestNetworkMask();
+            uint32_t node = FindNode(entry.GetDestNetwork().Get() & mask.Get(), mask.GetPrefixLength(), true);
+            std::vector<Route> &routes = m_nodes[node].routes;
+            for (std::vector<Route>::iterator it = routes.begin(); it != routes.end(); it++) {
+                if (it->entry.GetInterface() == entry.GetInterface()
+                        && it->entry.GetGateway() == entry.GetGateway()) {
+                    it->entry = entry;
+                    it->metric = metric;
+                    return;
+                }
+            }
+            Route route = {entry, metric};
+            routes.push_back(route);
+            m_nRoutes++;
+        }
+
+        uint32_t
+        LpmTable::Remove(const Ipv4Address &network, const Ipv4Mask &mask) {
+            uint16_t length = mask.GetPrefixLength();
+            uint32_t node = FindNode(network.Get() & mask.Get(), length, false);
+            if (node == 0 && length != 0) {
+                return 0;
+            }
+            // The emptied nodes stay, they are reused by the next route under that prefix.
+            uint32_t removed = m_nodes[node].routes.size();
+            m_nodes[node].routes.clear();
+            m_nRoutes -= removed;
+            return removed;
+        }
+
+        const LpmTable::Route*
+        LpmTable::Lookup(const Ipv4Address &dest, uint32_t interface) const {
+            uint32_t address = dest.Get();
+            const Route *best = NULL;
+            uint32_t node = 0;
+            for (uint16_t depth = 0;; depth++) {
+                const std::vector<Route> &routes = m_nodes[node].routes;
+                const Route *match = NULL;
+                for (std::vector<Route>::const_iterator it = routes.begin(); it != routes.end(); it++) {
+                    if (interface != Ipv4::IF_ANY && it->entry.GetInterface() != interface) {
+                        continue;
+                    }
+                    if (match == NULL || it->metric <= match->metric) {
+                        match = &(*it);
+                    }
+                }
+                if (match != NULL) {
+                    // Deeper is longer, it overrides what was found above.
+                    best = match;
+                }
+                if (depth == 32) {
+                    break;
+                }
+                node = m_nodes[node].child[(address >> (31 - depth)) & 1];
+                if (node == 0) {
+                    break;
+                }
+            }
+            return best;
+        }
+
+    }
+}
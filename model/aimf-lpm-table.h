@@ -0,0 +1,69 @@
+/*
+ * File:   aimf-lpm-table.h
+ * Author: debonatis
+ *
+ * Longest prefix match table for the unicast routes of AIMF.
+ */
+
+#ifndef AIMF_LPM_TABLE_H
+#define	AIMF_LPM_TABLE_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "ns3/ipv4-address.h"
+#include "ns3/ipv4-routing-table-entry.h"
+
+namespace ns3 {
+    namespace aimf {
+
+        /// Unicast routes in a binary trie over the destination bits.
+        ///
+        /// The trie nodes live in one vector and refer to their children by
+        /// index, a route sits at the node its prefix ends at. A lookup walks
+        /// at most 33 nodes whatever the number of routes and allocates nothing.
+        /// Routes are stored by value, the table owns them.
+
+        class LpmTable {
+        public:
+
+            struct Route {
+                Ipv4RoutingTableEntry entry;
+                uint32_t metric;
+            };
+
+            LpmTable();
+
+            /// Add a route. A route to the same network through the same
+            /// interface and gateway is replaced, so adding twice is harmless.
+            void Insert(const Ipv4RoutingTableEntry &entry, uint32_t metric);
+            /// Remove the routes to the network, return how many there were.
+            uint32_t Remove(const Ipv4Address &network, const Ipv4Mask &mask);
+            /// Longest prefix match for dest, the lowest metric among routes of
+            /// the same prefix length. With an interface other than
+            /// Ipv4::IF_ANY only routes through that interface are considered.
+            /// \return the route, or NULL if none matches
+            const Route* Lookup(const Ipv4Address &dest, uint32_t interface) const;
+            void Clear();
+            uint32_t GetNRoutes() const;
+
+        private:
+
+            struct Node {
+                /// Index of the child for bit 0 and bit 1, 0 if none (the root is never a child).
+                uint32_t child[2];
+                std::vector<Route> routes;
+            };
+
+            /// Index of the node for the prefix, created with its path if create is true.
+            /// \return the index, or 0 with create false and no such node
+            uint32_t FindNode(uint32_t prefix, uint16_t length, bool create);
+
+            std::vector<Node> m_nodes;
+            uint32_t m_nRoutes;
+        };
+
+    }
+}
+
+#endif	/* AIMF_LPM_TABLE_H */
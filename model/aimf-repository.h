@@ -11,12 +11,20 @@
 
 #include <set>
 #include <vector>
+#include <tr1/unordered_map>
 
 #include "ns3/ipv4-address.h"
+#include "ns3/ipv4-routing-table-entry.h"
+#include "ns3/ipv4-route.h"
 #include "ns3/nstime.h"
 #include "ns3/core-module.h"
 #include "ns3/network-module.h"
 
+/// Prefix length of an association or entry for one group.
+#define AIMF_SINGLE_GROUP_PREFIX 32
+/// Shortest group prefix, all of 224.0.0.0/4.
+#define AIMF_MIN_GROUP_PREFIX 4
+
 namespace ns3 {
     namespace aimf {
 
@@ -52,8 +60,28 @@ namespace ns3 {
 
             /// A value between 0 and 7 specifying the node's willingness to carry traffic on behalf of other nodes.
             uint8_t willingness;
+            /// ANSN of the last full association set received from the neighbor.
+            uint16_t ansn;
+            /// True once a full association set with that ANSN has been received.
+            bool synced;
+            /// ANSN and number of fragments of the full set being received,
+            /// 0 fragments while none is.
+            uint16_t pendingAnsn;
+            uint8_t pendingFragments;
+            /// The fragments of it received so far, one bit each, in any order.
+            uint32_t receivedFragments[8];
         };
 
+        static inline bool
+        IsFragmentReceived(const NeighborTuple &tuple, uint8_t fragment) {
+            return (tuple.receivedFragments[fragment / 32] & (1u << (fragment % 32))) != 0;
+        }
+
+        static inline void
+        SetFragmentReceived(NeighborTuple &tuple, uint8_t fragment) {
+            tuple.receivedFragments[fragment / 32] |= 1u << (fragment % 32);
+        }
+
         static inline bool
         operator==(const NeighborTuple &a, const NeighborTuple &b) {
             return (a.neighborMainAddr == b.neighborMainAddr
@@ -70,10 +98,26 @@ namespace ns3 {
 
 
 
+        /// Mask of a group prefix of the given length.
+        static inline uint32_t
+        GroupPrefixMask(uint8_t length) {
+            return length == 0 ? 0 : 0xffffffff << (32 - length);
+        }
+
+        /// Whether group/length lies within 224.0.0.0/4 and has no bits past the prefix.
+        static inline bool
+        IsGroupPrefix(uint32_t group, uint8_t length) {
+            return length >= AIMF_MIN_GROUP_PREFIX && length <= AIMF_SINGLE_GROUP_PREFIX
+                    && (group & ~GroupPrefixMask(length)) == 0
+                    && (group & GroupPrefixMask(AIMF_MIN_GROUP_PREFIX)) == 0xe0000000;
+        }
+
         /// Association
 
         struct Association {
+            /// With groupPrefixLength below 32, the first address of a range of groups.
             Ipv4Address group;
+            uint8_t groupPrefixLength;
             Ipv4Address source;
              Ipv4Address advertiser;
              uint8_t will;
@@ -82,12 +126,13 @@ namespace ns3 {
         static inline bool
         operator==(const Association &a, const Association &b) {
             return (a.group == b.group
+                    && a.groupPrefixLength == b.groupPrefixLength
                     && a.source == b.source);
         }
 
         static inline std::ostream&
         operator<<(std::ostream &os, const Association &tuple) {
-            os << "Association(groupAddr=" << tuple.group
+            os << "Association(groupAddr=" << tuple.group << "/" << (int) tuple.groupPrefixLength
                     << ", source=" << tuple.source
                     << ")";
             return os;
@@ -100,24 +145,28 @@ namespace ns3 {
             Ipv4Address advertiser;
 
             Ipv4Address group;
+            uint8_t groupPrefixLength;
             /// Network Address of network reachable through gatewayAddr
             Ipv4Address source;
             /// Time at which this tuple expires and must be removed
             Time expirationTime;
             /// The received TTL of group when SSM
             uint8_t will;
+            /// ANSN of the full association set that carried the tuple.
+            uint16_t ansn;
         };
 
         static inline bool
         operator==(const AssociationTuple &a, const AssociationTuple &b) {
             return (a.group == b.group
+                    && a.groupPrefixLength == b.groupPrefixLength
                     && a.source == b.source
                     && a.advertiser == b.advertiser);
         }
 
         static inline std::ostream&
         operator<<(std::ostream &os, const AssociationTuple &tuple) {
-            os << "AssociationTuple(group=" << tuple.group
+            os << "AssociationTuple(group=" << tuple.group << "/" << (int) tuple.groupPrefixLength
                     << ", source=" << tuple.source
                     << ", advertiser=" << tuple.advertiser
                     << ", expirationTime=" << tuple.expirationTime
@@ -128,12 +177,110 @@ namespace ns3 {
 
 
 
-        typedef std::vector<NeighborTuple> NeighborSet; ///< Neighbor Set type.
-        typedef std::map<Ipv4Address,Time> TimerMap;
+        /// Key of a multicast forwarding entry. A (*,G) entry has source == Ipv4Address::GetAny (),
+        /// an entry for a range of groups a groupPrefixLength below AIMF_SINGLE_GROUP_PREFIX.
+
+        struct SourceGroup {
+            Ipv4Address source;
+            Ipv4Address group;
+            uint8_t groupPrefixLength;
+        };
+
+        static inline bool
+        operator==(const SourceGroup &a, const SourceGroup &b) {
+            return (a.source == b.source
+                    && a.group == b.group
+                    && a.groupPrefixLength == b.groupPrefixLength);
+        }
+
+        static inline std::ostream&
+        operator<<(std::ostream &os, const SourceGroup &key) {
+            os << "(" << key.source << "," << key.group;
+            if (key.groupPrefixLength != AIMF_SINGLE_GROUP_PREFIX) {
+                os << "/" << (int) key.groupPrefixLength;
+            }
+            os << ")";
+            return os;
+        }
+
+        struct SourceGroupHash : public std::unary_function<SourceGroup, size_t> {
+
+            size_t operator()(const SourceGroup &key) const {
+                uint32_t h = key.group.Get() ^ key.groupPrefixLength;
+                h ^= key.source.Get() + 0x9e3779b9 + (h << 6) + (h >> 2);
+                return h;
+            }
+        };
+
+
+
+        /// A multicast forwarding entry
+
+        struct MulticastFibEntry {
+            /// The (S,G) state as installed by the routing table computation.
+            Ipv4MulticastRoutingTableEntry entry;
+            /// Route built from entry, handed to Ipv4L3Protocol for every forwarded packet.
+            Ptr<Ipv4MulticastRoute> mroute;
+            /// Number of local associations and association tuples that install this entry.
+            uint32_t refs;
+            /// True if this node is the designated forwarder of the (S,G).
+            bool forward;
+            /// Packets and bytes received for the entry, the only per packet bookkeeping.
+            /// Counted through the const entries the lookups return.
+            mutable uint64_t packets;
+            mutable uint64_t bytes;
+            /// Counters at the previous activity sample.
+            uint64_t sampledPackets;
+            uint64_t sampledBytes;
+            /// Smoothed receive rates, in packets and bytes per second.
+            double packetRate;
+            double byteRate;
+            /// Last sample that saw new packets.
+            Time lastActive;
+            /// True while packets arrive within the activity timeout.
+            bool spotted;
+        };
+
+
+
+        /// Index key of an association tuple.
+
+        struct AssociationKey {
+            Ipv4Address advertiser;
+            Ipv4Address group;
+            uint8_t groupPrefixLength;
+            Ipv4Address source;
+        };
+
+        static inline bool
+        operator==(const AssociationKey &a, const AssociationKey &b) {
+            return (a.advertiser == b.advertiser
+                    && a.group == b.group
+                    && a.groupPrefixLength == b.groupPrefixLength
+                    && a.source == b.source);
+        }
+
+        struct AssociationKeyHash : public std::unary_function<AssociationKey, size_t> {
+
+            size_t operator()(const AssociationKey &key) const {
+                uint32_t h = key.group.Get() ^ key.groupPrefixLength;
+                h ^= key.source.Get() + 0x9e3779b9 + (h << 6) + (h >> 2);
+                h ^= key.advertiser.Get() + 0x9e3779b9 + (h << 6) + (h >> 2);
+                return h;
+            }
+        };
+
+
+
+        /// Neighbor Set type, indexed by neighbor main address.
+        /// Tuples do not move in memory until they are erased, so a pointer to one is a stable handle.
+        typedef std::tr1::unordered_map<Ipv4Address, NeighborTuple, Ipv4AddressHash> NeighborSet;
         typedef std::vector<IfaceAssocTuple> IfaceAssocSet; ///< Interface Association Set type.
-        typedef std::vector<AssociationTuple> AssociationSet; ///< Association Set type.
+        /// Association Set type, indexed by (advertiser, group prefix, source). Handles are stable as for NeighborSet.
+        typedef std::tr1::unordered_map<AssociationKey, AssociationTuple, AssociationKeyHash> AssociationSet;
         typedef std::vector<Association> Associations;
         typedef std::vector<uint8_t> UniqnessTable;///< Association Set type.
+        typedef std::tr1::unordered_map<SourceGroup, MulticastFibEntry, SourceGroupHash> MulticastFib; ///< (S,G)/(*,G) forwarding table.
         
 
 
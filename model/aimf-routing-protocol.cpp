@@ -5,10 +5,25 @@
  * Created on 19 February 2016, 12:59
  */
 #define NS_LOG_APPEND_CONTEXT                                   \
-  if (GetObject<Node> ()) { std::clog << "[node " << GetObject<Node> ()->GetId () << "] "; }
+  if (m_ipv4) { std::clog << "[node " << m_nodeId << "] "; }
 
 
 #include "ns3/log.h"
+
+/// Per packet logging of RouteInput, RouteOutput, LookupStatic and
+/// SourceAddressSelection.
+/// Configure with --disable-aimf-datapath-log to compile it out of
+/// a build that keeps the rest of the AIMF logging.
+#ifdef AIMF_DISABLE_DATAPATH_LOG
+#define AIMF_DATAPATH_LOG_FUNCTION(parameters)
+#define AIMF_DATAPATH_LOG_LOGIC(msg)
+#define AIMF_DATAPATH_LOG_DEBUG(msg)
+#else
+#define AIMF_DATAPATH_LOG_FUNCTION(parameters) NS_LOG_FUNCTION(parameters)
+#define AIMF_DATAPATH_LOG_LOGIC(msg) NS_LOG_LOGIC(msg)
+#define AIMF_DATAPATH_LOG_DEBUG(msg) NS_LOG_DEBUG(msg)
+#endif
+#include "ns3/abort.h"
 #include "ns3/socket-factory.h"
 #include "ns3/udp-socket-factory.h"
 #include "ns3/simulator.h"
@@ -29,33 +44,30 @@
 #include "ns3/aimf-routing-protocol.h"
 #include "aimf-routing-protocol.h"
 
+#include <algorithm>
 
 
 
 ///
-/// \brief Gets the delay between a given time and the current time.
-///
-/// If given time is previous to the current one, then this macro returns
-/// a number close to 0. This is used for scheduling events at a certain moment.
-///
-#define DELAY(time) (((time) < (Simulator::Now ())) ? Seconds (0.000001) : \
-                     (time - Simulator::Now () + Seconds (0.000001)))
-
 
 
 ///
 /// \brief Period at which a node must cite neighbor.
 ///
 /// We only use this value in order to define AIMF_NEIGHB_HOLD_TIME.
+/// It is the interval advertised as Htime, which grows in AdaptiveHello mode.
 ///
-#define AIMF_REFRESH_INTERVAL   m_helloInterval
+#define AIMF_REFRESH_INTERVAL   m_currentHelloInterval
 
 
 /********** Holding times **********/
 
+/// Neighbor holding time, in advertised HELLO intervals.
+#define AIMF_NEIGHB_HOLD_FACTOR 3
 /// Neighbor holding time.
-#define AIMF_NEIGHB_HOLD_TIME   Time (3 * AIMF_REFRESH_INTERVAL)
-#define IS_RECEVING_MCAST  Time (4*AIMF_REFRESH_INTERVAL)
+#define AIMF_NEIGHB_HOLD_TIME   Time (AIMF_NEIGHB_HOLD_FACTOR * AIMF_REFRESH_INTERVAL)
+/// Weight of the newest sample in the smoothed group rates.
+#define AIMF_RATE_WEIGHT 0.25
 
 
 
@@ -71,6 +83,8 @@
 #define AIMF_WILL_HIGH          6
 /// Willingness for forwarding packets: always.
 #define AIMF_WILL_ALWAYS        7
+/// Per-group willingness of an association: use the node willingness.
+#define AIMF_WILL_INHERIT       255
 
 #define AIMF_MCAST_ADR "230.0.0.30"
 /********** Miscellaneous constants **********/
@@ -80,6 +94,8 @@
 #define AIMF_MAX_SEQ_NUM        65535
 
 #define AIMF_PORT_NUMBER 1337
+/// IPv4 and UDP headers in front of an AIMF packet.
+#define AIMF_IP_UDP_HEADER_SIZE 28
 
 
 using std::make_pair;
@@ -101,10 +117,6 @@ namespace ns3 {
                     TimeValue(Seconds(2)),
                     MakeTimeAccessor(&RoutingProtocol::m_helloInterval),
                     MakeTimeChecker())
-                    .AddAttribute("olsrPollInterval", "The poll interval of the OLSR routing table.",
-                    TimeValue(Seconds(5)),
-                    MakeTimeAccessor(&RoutingProtocol::m_olsrCheckInterval),
-                    MakeTimeChecker())
                     .AddAttribute("Willingness", "Willingness of a node to carry and forward traffic compared to other similar nodes.",
                     EnumValue(AIMF_WILL_DEFAULT),
                     MakeEnumAccessor(&RoutingProtocol::m_willingness),
@@ -113,9 +125,51 @@ namespace ns3 {
                     AIMF_WILL_DEFAULT, "default",
                     AIMF_WILL_HIGH, "high",
                     AIMF_WILL_ALWAYS, "always"))
+                    .AddAttribute("SweepInterval", "Interval at which expired neighbors, association tuples and group activity are removed in one batch.",
+                    TimeValue(MilliSeconds(500)),
+                    MakeTimeAccessor(&RoutingProtocol::m_sweepInterval),
+                    MakeTimeChecker())
+                    .AddAttribute("ActivityTimeout", "Time without packets after which a group is no longer spotted.",
+                    TimeValue(Seconds(8)),
+                    MakeTimeAccessor(&RoutingProtocol::m_activityTimeout),
+                    MakeTimeChecker())
+                    .AddAttribute("MaxJitter", "Upper bound of the random delay of HELLOs (RFC 5148), must be below HelloInterval.",
+                    TimeValue(MilliSeconds(500)),
+                    MakeTimeAccessor(&RoutingProtocol::m_maxJitter),
+                    MakeTimeChecker())
+                    .AddAttribute("AdaptiveHello", "Double the HELLO interval up to MaxHelloInterval while nothing changes, back to HelloInterval on a change.",
+                    BooleanValue(false),
+                    MakeBooleanAccessor(&RoutingProtocol::m_adaptiveHello),
+                    MakeBooleanChecker())
+                    .AddAttribute("MaxHelloInterval", "Longest HELLO interval in AdaptiveHello mode.",
+                    TimeValue(Seconds(20)),
+                    MakeTimeAccessor(&RoutingProtocol::m_maxHelloInterval),
+                    MakeTimeChecker())
+                    .AddAttribute("DeltaHello", "Send the association set only when its ANSN changes or FullHelloInterval has passed, small HELLOs otherwise.",
+                    BooleanValue(false),
+                    MakeBooleanAccessor(&RoutingProtocol::m_deltaHello),
+                    MakeBooleanChecker())
+                    .AddAttribute("FullHelloInterval", "Longest time between two HELLOs carrying the association set in DeltaHello mode.",
+                    TimeValue(Seconds(20)),
+                    MakeTimeAccessor(&RoutingProtocol::m_fullHelloInterval),
+                    MakeTimeChecker())
+                    .AddAttribute("AggregationWindow", "How long a message waits for other messages to share its packet, 0 to send every message in a packet of its own.",
+                    TimeValue(MilliSeconds(10)),
+                    MakeTimeAccessor(&RoutingProtocol::m_aggregationWindow),
+                    MakeTimeChecker())
+                    .AddAttribute("LoadSharing", "Elect a forwarder per (S,G) among the most willing gateways instead of one for all groups.",
+                    BooleanValue(true),
+                    MakeBooleanAccessor(&RoutingProtocol::m_loadSharing),
+                    MakeBooleanChecker())
                     .AddTraceSource("RoutingTableChanged", "The AIMF routing table has changed.",
                     MakeTraceSourceAccessor(&RoutingProtocol::m_routingTableChanged),
                     "ns3::aimf::RoutingProtocol::TableChangeTracedCallback")
+                    .AddTraceSource("RoutingTableDelta", "The (S,G) entries added to and removed from the AIMF routing table.",
+                    MakeTraceSourceAccessor(&RoutingProtocol::m_routingTableDelta),
+                    "ns3::aimf::RoutingProtocol::TableDeltaTracedCallback")
+                    .AddTraceSource("NeighborLost", "A neighbor expired without a HELLO within its hold time.",
+                    MakeTraceSourceAccessor(&RoutingProtocol::m_neighborLost),
+                    "ns3::aimf::RoutingProtocol::NeighborTracedCallback")
                     .AddTraceSource("Rx", "Receive AIMF packet.",
                     MakeTraceSourceAccessor(&RoutingProtocol::m_rxHelloPacketTrace),
                     "ns3::aimf::RoutingProtocol::PacketTxRxTracedCallback")
@@ -128,15 +182,33 @@ namespace ns3 {
                     .AddTraceSource("McRx", "Receive multicast packet.",
                     MakeTraceSourceAccessor(&RoutingProtocol::m_rxMcastPacketTrace),
                     "ns3::aimf::RoutingProtocol::PacketTxRxTracedCallback")
+                    .AddTraceSource("GroupActivity", "A (S,G) entry started or stopped receiving packets.",
+                    MakeTraceSourceAccessor(&RoutingProtocol::m_groupActivity),
+                    "ns3::aimf::RoutingProtocol::ActivityTracedCallback")
                     ;
             return tid;
         }
 
         RoutingProtocol::RoutingProtocol() :
         m_routingTableAssociation(0),
+        forward(false),
+        m_forwardingEntries(0),
+        m_malformedPackets(0),
+        m_ansn(0),
         m_ipv4(0),
-        m_helloTimer(Timer::CANCEL_ON_DESTROY), m_olsrCheck(Timer::CANCEL_ON_DESTROY) {
+        m_nodeId(0),
+        m_helloTimer(Timer::CANCEL_ON_DESTROY),
+        m_sweepTimer(Timer::CANCEL_ON_DESTROY),
+        m_queuedMessagesTimer(Timer::CANCEL_ON_DESTROY),
+        m_running(false),
+        m_loadSharing(true),
+        m_fullHelloAnsn(0),
+        m_resyncRequested(false),
+        m_helloTemplateValid(false) {
             m_uniformRandomVariable2 = CreateObject<UniformRandomVariable> ();
+            for (uint8_t i = 0; i <= AIMF_SINGLE_GROUP_PREFIX; i++) {
+                m_groupPrefixEntries[i] = 0;
+            }
 
 
 
@@ -151,8 +223,6 @@ namespace ns3 {
 
         ns3::Ptr<ns3::Ipv4StaticRouting> m_RoutingTable;
 
-        ns3::EventGarbageCollector m_events;
-
         /// Packets sequence number counter.
         uint16_t m_packetSequenceNumber;
         /// Messages sequence number counter.
@@ -160,8 +230,6 @@ namespace ns3 {
 
         /// HELLO messages' emission interval.
         Time m_helloInterval;
-        /// OLSR check interval.
-        Time m_olsrCheckInterval;
 
         volatile uint8_t m_willingness;
         volatile uint8_t m_lastwill;
@@ -189,9 +257,10 @@ namespace ns3 {
             Ptr<Packet> receivedPacket;
             Address sourceAddress;
             receivedPacket = socket->RecvFrom(sourceAddress);
-            Ptr<Packet> k = receivedPacket->Copy();
 
-            m_rxHelloPacketTrace(k, m_ipv4, socket->GetBoundNetDevice()->GetIfIndex());
+            // The messages are parsed from a copy of the bytes and the packet
+            // is never modified, sinks see it as it was received.
+            m_rxHelloPacketTrace(receivedPacket, m_ipv4, socket->GetBoundNetDevice()->GetIfIndex());
 
             InetSocketAddress inetSourceAddr = InetSocketAddress::ConvertFrom(sourceAddress);
             Ipv4Address senderIfaceAddr = inetSourceAddr.GetIpv4();
@@ -204,200 +273,205 @@ namespace ns3 {
             // so we check it.
             NS_ASSERT(inetSourceAddr.GetPort() == AIMF_PORT_NUMBER);
 
-            Ptr<Packet> packet = receivedPacket;
-
-            aimf::PacketHeader aimfPacketHeader;
-            packet->RemoveHeader(aimfPacketHeader);
-            NS_ASSERT(aimfPacketHeader.GetPacketLength() >= aimfPacketHeader.GetSerializedSize());
-            uint32_t sizeLeft = aimfPacketHeader.GetPacketLength() - aimfPacketHeader.GetSerializedSize();
-
-            MessageList messages;
-
-            while (sizeLeft) {
-                MessageHeader messageHeader;
-                if (packet->RemoveHeader(messageHeader) == 0)
-                    NS_ASSERT(false);
-
-                sizeLeft -= messageHeader.GetSerializedSize();
-
-                NS_LOG_DEBUG("Aimf Msg received with type "
-                        << std::dec << int (messageHeader.GetMessageType())
-                        << " TTL=" << int (messageHeader.GetTimeToLive())
-                        << " origAddr=" << messageHeader.GetOriginatorAddress());
-                messages.push_back(messageHeader);
+            // The messages are read in place from one copy of the packet bytes.
+            uint32_t size = receivedPacket->GetSize();
+            if (m_rxBuffer.size() < size) {
+                m_rxBuffer.resize(size);
             }
+            if (size > 0) {
+                receivedPacket->CopyData(&m_rxBuffer[0], size);
+            }
+            aimf::PacketReader reader(size > 0 ? &m_rxBuffer[0] : NULL, size);
+            aimf::MessageView message;
+            bool malformed = false;
 
-
-
-            for (MessageList::const_iterator messageIter = messages.begin();
-                    messageIter != messages.end(); messageIter++) {
-                const MessageHeader &messageHeader = *messageIter;
+            while (!malformed && reader.Next(message)) {
+                NS_LOG_DEBUG("Aimf Msg received with type "
+                        << std::dec << int (message.messageType)
+                        << " TTL=" << int (message.timeToLive)
+                        << " origAddr=" << message.originatorAddress);
                 // If ttl is less than or equal to zero, or
                 // the receiver is the same as the originator,
                 // the message must be silently dropped
-                if (messageHeader.GetTimeToLive() == 0
-                        || messageHeader.GetOriginatorAddress() == m_mainAddress) {
-                    packet->RemoveAtStart(messageHeader.GetSerializedSize()
-                            - messageHeader.GetSerializedSize());
+                if (message.timeToLive == 0
+                        || message.originatorAddress == m_mainAddress) {
                     continue;
                 }
-                switch (messageHeader.GetMessageType()) {
+                switch (message.messageType) {
                     case aimf::MessageHeader::HELLO_MESSAGE:
-                        NS_LOG_DEBUG(Simulator::Now().GetSeconds()
-                                << "s AIMF node " << m_mainAddress
-                                << " received HELLO message of size " << messageHeader.GetSerializedSize());
-                        ProcessHello(messageHeader, receiverIfaceAddr, senderIfaceAddr);
+                    {
+                        aimf::HelloView hello;
+                        malformed = !aimf::PacketReader::ReadHello(message, hello);
+                        if (!malformed) {
+                            NS_LOG_DEBUG(Simulator::Now().GetSeconds()
+                                    << "s AIMF node " << m_mainAddress
+                                    << " received HELLO message with " << hello.nAssociations << " associations");
+                            ProcessHello(message, hello, receiverIfaceAddr, senderIfaceAddr);
+                        }
                         break;
-
+                    }
+                    case aimf::MessageHeader::RESYNC_MESSAGE:
+                    {
+                        aimf::MessageHeader::Resync resync;
+                        malformed = !aimf::PacketReader::ReadResync(message, resync);
+                        if (!malformed) {
+                            ProcessResync(resync);
+                        }
+                        break;
+                    }
+                    case aimf::MessageHeader::GOODBYE_MESSAGE:
+                    {
+                        aimf::MessageHeader::Goodbye goodbye;
+                        malformed = !aimf::PacketReader::ReadGoodbye(message, goodbye);
+                        if (!malformed) {
+                            ProcessGoodbye(message, goodbye);
+                        }
+                        break;
+                    }
 
                     default:
                         NS_LOG_DEBUG("AIMF message type " <<
-                                int (messageHeader.GetMessageType()) <<
+                                int (message.messageType) <<
                                 " not implemented");
                 }
-
             }
-            RoutingTableComputation();
+            if (malformed || reader.IsMalformed()) {
+                // The messages before the bad one have been processed, they
+                // are complete on their own.
+                m_malformedPackets++;
+                NS_LOG_WARN("AIMF node " << m_mainAddress << " dropped a malformed packet from "
+                        << senderIfaceAddr << " (" << size << " bytes)");
+            }
+            NotifyTableChange();
         }
 
         void
-        RoutingProtocol::ReceivingMulticast(Ipv4Address group) {
-
-            Time * t = m_state.FindTimer(group);
-            if (t == NULL) {
-                Time k = Simulator::Now() + IS_RECEVING_MCAST + Time::FromInteger((int) (7 - m_willingness)*2, Time::S);
-                m_state.AddTimer(group, k);
-                Simulator::ScheduleWithContext(group.Get() + GetObject<Node> ()->GetId(), DELAY(k), &aimf::RoutingProtocol::ReceivingMulticast, this, group);
-                t = m_state.FindTimer(group);
+        RoutingProtocol::SampleActivity(const Time &now) {
+            double elapsed = (now - m_lastActivitySample).GetSeconds();
+            m_lastActivitySample = now;
+            if (elapsed <= 0) {
+                return;
             }
-            if (*t < Simulator::Now()) {
-                NS_LOG_DEBUG(Simulator::Now().GetSeconds() << " " << group << " is not spotted. ");
-                NS_LOG_DEBUG("Old time: " << t->GetSeconds() << ".");
-                *t = *t + IS_RECEVING_MCAST + Seconds(m_willingness);
-                NS_LOG_DEBUG("New time: " << t->GetSeconds() << ".");
-            } else if (*t > Simulator::Now()) {
-                NS_LOG_DEBUG(Simulator::Now().GetSeconds() << " " << group << " is spotted. ");
-                NS_LOG_DEBUG("Old time: " << t->GetSeconds() << ".");
-                *t = Simulator::Now() + IS_RECEVING_MCAST + Time::FromInteger((int) (AIMF_WILL_ALWAYS - m_willingness), Time::S);
-                NS_LOG_DEBUG("New time: " << t->GetSeconds() << ".");
+            for (MulticastFib::iterator it = m_table.begin(); it != m_table.end(); it++) {
+                MulticastFibEntry &fib = it->second;
+                uint64_t packets = fib.packets - fib.sampledPackets;
+                uint64_t bytes = fib.bytes - fib.sampledBytes;
+                fib.sampledPackets = fib.packets;
+                fib.sampledBytes = fib.bytes;
+                fib.packetRate += AIMF_RATE_WEIGHT * (packets / elapsed - fib.packetRate);
+                fib.byteRate += AIMF_RATE_WEIGHT * (bytes / elapsed - fib.byteRate);
+                if (packets > 0) {
+                    fib.lastActive = now;
+                }
+                bool spotted = packets > 0 || (fib.spotted && now - fib.lastActive < m_activityTimeout);
+                if (spotted != fib.spotted) {
+                    fib.spotted = spotted;
+                    NS_LOG_DEBUG(now.GetSeconds() << " " << it->first << (spotted ? " is spotted." : " is not spotted.")
+                            << " Rate " << fib.packetRate << " packets/s.");
+                    m_groupActivity(it->first, spotted);
+                }
             }
         }
         Ptr<Ipv4Route>
         RoutingProtocol::LookupStatic(Ipv4Address dest, Ptr<NetDevice> oif) {
-            NS_LOG_FUNCTION(this << dest << " " << oif);
-            Ptr<Ipv4Route> rtentry = 0;
-            uint16_t longest_mask = 0;
-            uint32_t shortest_metric = 0xffffffff;
+            AIMF_DATAPATH_LOG_FUNCTION(this << dest << " " << oif);
             if (dest.IsLocalMulticast()) {
                 NS_ASSERT_MSG(oif, "Try to send on link-local multicast address, and no interface index is given!");
-                NS_LOG_DEBUG("src address= " << m_ipv4->GetAddress(oif->GetIfIndex() + 1, 0).GetLocal());
-                rtentry = Create<Ipv4Route> ();
-                rtentry->SetDestination(dest);
-                rtentry->SetGateway(m_ipv4->GetAddress(oif->GetIfIndex() + 1, 0).GetLocal());
-                rtentry->SetOutputDevice(oif);
-                rtentry->SetSource(m_ipv4->GetAddress(oif->GetIfIndex() + 1, 0).GetLocal());
+                // The HELLOs go out this way, so the route is built once per interface.
+                uint32_t index = oif->GetIfIndex();
+                if (index >= m_linkLocalRoutes.size()) {
+                    m_linkLocalRoutes.resize(index + 1);
+                }
+                Ptr<Ipv4Route> &rtentry = m_linkLocalRoutes[index];
+                if (rtentry == 0 || rtentry->GetDestination() != dest) {
+                    Ipv4Address local = m_ipv4->GetAddress(index + 1, 0).GetLocal();
+                    AIMF_DATAPATH_LOG_DEBUG("src address= " << local);
+                    rtentry = Create<Ipv4Route> ();
+                    rtentry->SetDestination(dest);
+                    rtentry->SetGateway(local);
+                    rtentry->SetOutputDevice(oif);
+                    rtentry->SetSource(local);
+                }
                 return rtentry;
             }
-            for (NetworkRoutesI i = m_networkRoutes.begin();
-                    i != m_networkRoutes.end();
-                    i++) {
-                Ipv4RoutingTableEntry *j = i->first;
-                uint32_t metric = i->second;
-                Ipv4Mask mask = (j)->GetDestNetworkMask();
-                uint16_t masklen = mask.GetPrefixLength();
-                Ipv4Address entry = (j)->GetDestNetwork();
-                NS_LOG_LOGIC("Searching for route to " << dest << ", checking against route to " << entry << "/" << masklen);
-                if (mask.IsMatch(dest, entry)) {
-                    NS_LOG_LOGIC("Found global network route " << j << ", mask length " << masklen << ", metric " << metric);
-                    if (oif != 0) {
-                        if (oif != m_ipv4->GetNetDevice(j->GetInterface())) {
-                            NS_LOG_LOGIC("Not on requested interface, skipping");
-                            continue;
-                        }
-                    }
-                    if (masklen < longest_mask) // Not interested if got shorter mask
-                    {
-                        NS_LOG_LOGIC("Previous match longer, skipping");
-                        continue;
-                    }
-                    if (masklen > longest_mask) // Reset metric if longer masklen
-                    {
-                        shortest_metric = 0xffffffff;
-                    }
-                    longest_mask = masklen;
-                    if (metric > shortest_metric) {
-                        NS_LOG_LOGIC("Equal mask length, but previous metric shorter, skipping");
-                        continue;
-                    }
-                    shortest_metric = metric;
-                    Ipv4RoutingTableEntry* route = (j);
-                    uint32_t interfaceIdx = route->GetInterface();
-                    rtentry = Create<Ipv4Route> ();
-                    rtentry->SetDestination(route->GetDest());
-                    rtentry->SetSource(SourceAddressSelection(interfaceIdx, route->GetDest()));
-                    rtentry->SetGateway(route->GetGateway());
-                    rtentry->SetOutputDevice(m_ipv4->GetNetDevice(interfaceIdx));
+            uint32_t interface = Ipv4::IF_ANY;
+            if (oif != 0) {
+                int32_t oifInterface = m_ipv4->GetInterfaceForDevice(oif);
+                if (oifInterface < 0) {
+                    AIMF_DATAPATH_LOG_LOGIC("No matching route to " << dest << " found");
+                    return 0;
                 }
+                interface = oifInterface;
             }
-            if (rtentry != 0) {
-                NS_LOG_LOGIC("Matching route via " << rtentry->GetGateway() << " at the end");
-            } else {
-                NS_LOG_LOGIC("No matching route to " << dest << " found");
+            const LpmTable::Route *route = m_networkRoutes.Lookup(dest, interface);
+            if (route == NULL) {
+                AIMF_DATAPATH_LOG_LOGIC("No matching route to " << dest << " found");
+                return 0;
             }
+            uint32_t interfaceIdx = route->entry.GetInterface();
+            Ptr<Ipv4Route> rtentry = Create<Ipv4Route> ();
+            rtentry->SetDestination(route->entry.GetDest());
+            rtentry->SetSource(SourceAddressSelection(interfaceIdx, route->entry.GetDest()));
+            rtentry->SetGateway(route->entry.GetGateway());
+            rtentry->SetOutputDevice(m_ipv4->GetNetDevice(interfaceIdx));
+            AIMF_DATAPATH_LOG_LOGIC("Matching route via " << rtentry->GetGateway() << " at the end");
             return rtentry;
         }
-        Ptr<Ipv4MulticastRoute>
+        const MulticastFibEntry*
         RoutingProtocol::LookupStatic(
                 Ipv4Address origin,
                 Ipv4Address group,
                 uint32_t interface, uint8_t ttl) {
-            NS_LOG_FUNCTION(this << origin << " " << group << " " << interface);
-            Ptr<Ipv4MulticastRoute> mrtentry = 0;
-            NS_LOG_DEBUG("Node " << m_mainAddress << "(S,G) pair: (" << origin << "," << group << ")");
-            for (std::map<Ipv4Address, Ipv4MulticastRoutingTableEntry>::const_iterator i = m_table.begin();
-                    i != m_table.end();
-                    i++) {
-                Ipv4MulticastRoutingTableEntry route = i->second;
-
-                if (origin == route.GetOrigin() && group == route.GetGroup() && group == i->first) {
-                    // TODO Use will for each multicast flow. The TTL should be used.
-                    NS_LOG_LOGIC("Found multicast source specific route" << i->first);
-                }
-                if (group == route.GetGroup() && group == i->first) {
-                    if (interface == Ipv4::IF_ANY ||
-                            interface == route.GetInputInterface()) {
-                        ReceivingMulticast(group);
-                        NS_LOG_LOGIC("Found multicast route" << i->first);
-                        mrtentry = Create<Ipv4MulticastRoute> ();
-                        mrtentry->SetGroup(route.GetGroup());
-                        mrtentry->SetOrigin(route.GetOrigin());
-                        mrtentry->SetParent(route.GetInputInterface());
-                        for (uint32_t j = 0; j < route.GetNOutputInterfaces(); j++) {
-                            if (route.GetOutputInterface(j)) {
-                                NS_LOG_LOGIC("Setting output interface index " << route.GetOutputInterface(j));
-                                mrtentry->SetOutputTtl(route.GetOutputInterface(j), Ipv4MulticastRoute::MAX_TTL - 1);
-                            }
-                        }
-                        return mrtentry;
-                    }
-                    //                    else{
-                    //                        mrtentry = Create<Ipv4MulticastRoute> ();
-                    //                        mrtentry->SetGroup(route.GetGroup());
-                    //                        mrtentry->SetOrigin(route.GetOrigin());
-                    //                        mrtentry->SetParent(2);
-                    //                        mrtentry->SetOutputTtl(2, Ipv4MulticastRoute::MAX_TTL - 1);
-                    //                        
-                    //                    }
-                    ///ALERT PIM there is a "new" multicast group spotted on the MANET                    
-                }
+            AIMF_DATAPATH_LOG_FUNCTION(this << origin << " " << group << " " << interface);
+            AIMF_DATAPATH_LOG_DEBUG("Node " << m_mainAddress << "(S,G) pair: (" << origin << "," << group << ")");
+            const MulticastFibEntry *fib = FindEntry(origin, group);
+            if (fib == NULL) {
+                ///ALERT PIM there is a "new" multicast group spotted on the MANET
+                return NULL;
+            }
+            if (interface == Ipv4::IF_ANY ||
+                    interface == fib->entry.GetInputInterface()) {
+                AIMF_DATAPATH_LOG_LOGIC("Found multicast route (" << fib->entry.GetOrigin() << "," << fib->entry.GetGroup() << ")");
+                return fib;
             }
+            return NULL;
+        }
 
-            return mrtentry;
+        const MulticastFibEntry*
+        RoutingProtocol::FindEntry(const Ipv4Address &origin, const Ipv4Address &group) const {
+            SourceGroup key = {origin, group, AIMF_SINGLE_GROUP_PREFIX};
+            MulticastFib::const_iterator i = m_table.find(key);
+            if (i != m_table.end()) {
+                return &(i->second);
+            }
+            // No source specific state, fall back to the (*,G) entry.
+            key.source = Ipv4Address::GetAny();
+            i = m_table.find(key);
+            if (i != m_table.end()) {
+                return &(i->second);
+            }
+            // Then the group ranges, longest prefix first. Without any this loop is empty.
+            for (std::vector<uint8_t>::const_iterator length = m_groupPrefixLengths.begin();
+                    length != m_groupPrefixLengths.end(); length++) {
+                key.group = Ipv4Address(group.Get() & GroupPrefixMask(*length));
+                key.groupPrefixLength = *length;
+                key.source = origin;
+                i = m_table.find(key);
+                if (i != m_table.end()) {
+                    return &(i->second);
+                }
+                key.source = Ipv4Address::GetAny();
+                i = m_table.find(key);
+                if (i != m_table.end()) {
+                    return &(i->second);
+                }
+            }
+            return NULL;
         }
 
         Ipv4Address
         RoutingProtocol::SourceAddressSelection(uint32_t interfaceIdx, Ipv4Address dest) {
-            NS_LOG_FUNCTION(this << interfaceIdx << " " << dest);
+            AIMF_DATAPATH_LOG_FUNCTION(this << interfaceIdx << " " << dest);
             if (m_ipv4->GetNAddresses(interfaceIdx) == 1) // common case
             {
                 return m_ipv4->GetAddress(interfaceIdx, 0).GetLocal();
@@ -418,9 +492,13 @@ namespace ns3 {
         RoutingProtocol::SetIpv4(Ptr<Ipv4> ipv4) {
             NS_ASSERT(ipv4 != 0);
             NS_ASSERT(m_ipv4 == 0);
+            // Cached for NS_LOG_APPEND_CONTEXT, which runs on every log statement.
+            Ptr<Node> node = ipv4->GetObject<Node> ();
+            m_nodeId = node ? node->GetId() : 0;
             NS_LOG_DEBUG("Created aimf::RoutingProtocol");
             m_helloTimer.SetFunction(&RoutingProtocol::HelloTimerExpire, this);
-            m_olsrCheck.SetFunction(&RoutingProtocol::OlsrTimerExpire, this);
+            m_sweepTimer.SetFunction(&RoutingProtocol::SweepTimerExpire, this);
+            m_queuedMessagesTimer.SetFunction(&RoutingProtocol::SendQueuedMessages, this);
             m_packetSequenceNumber = AIMF_MAX_SEQ_NUM;
             m_messageSequenceNumber = AIMF_MAX_SEQ_NUM;
             Ptr<Ipv4RoutingProtocol> nodeRouting = (ipv4->GetRoutingProtocol());
@@ -432,43 +510,84 @@ namespace ns3 {
                     m_olsr_onNode = DynamicCast<olsr::RoutingProtocol>(temp);
                 }
             }
+            if (m_olsr_onNode) {
+                // Rerun the forwarder election whenever the MANET topology changes.
+                m_olsr_onNode->TraceConnectWithoutContext("RoutingTableChanged",
+                        MakeCallback(&RoutingProtocol::OlsrRoutingTableChanged, this));
+            }
             m_ipv4 = ipv4;
         }
         void RoutingProtocol::DoDispose() {
-            m_ipv4 = 0;
-            m_table.clear();
-            m_state.ClearTimer();
+            // OLSR may outlive us, it must not call back into a disposed object.
+            if (m_olsr_onNode) {
+                m_olsr_onNode->TraceDisconnectWithoutContext("RoutingTableChanged",
+                        MakeCallback(&RoutingProtocol::OlsrRoutingTableChanged, this));
+                m_olsr_onNode = 0;
+            }
+            Clear();
             for (std::map< Ptr<Socket>, Ipv4InterfaceAddress >::iterator iter = m_socketAddresses.begin();
                     iter != m_socketAddresses.end(); iter++) {
                 iter->first->Close();
             }
             m_socketAddresses.clear();
+            m_networkRoutes.Clear();
+            m_linkLocalRoutes.clear();
 
             m_helloTimer.Cancel();
-            m_olsrCheck.Cancel();
+            m_sweepTimer.Cancel();
+            m_queuedMessagesTimer.Cancel();
+            m_queuedMessages.clear();
+            m_queuedMessageSizes.clear();
+            m_triggeredHello.Cancel();
+            m_running = false;
             forward = false;
             m_willingness = 1;
+            m_ipv4 = 0;
         }
         void RoutingProtocol::DoStop() {
-            m_table.clear();
-            m_state.ClearTimer();
+            if (!m_running) {
+                // Stopped already, or never started: nothing to tear down.
+                return;
+            }
+            // Tell the neighbors before the sockets go away, without waiting
+            // for the aggregation window.
+            SendGoodbye(true);
+            SendQueuedMessages();
+            // Withdraw every entry through the traces, listeners keep them otherwise.
+            for (MulticastFib::const_iterator it = m_table.begin(); it != m_table.end(); it++) {
+                if (it->second.spotted) {
+                    m_groupActivity(it->first, false);
+                }
+                RecordTableChange(it->first, false);
+            }
+            Clear();
+            NotifyTableChange();
             for (std::map< Ptr<Socket>, Ipv4InterfaceAddress >::iterator iter = m_socketAddresses.begin();
                     iter != m_socketAddresses.end(); iter++) {
                 iter->first->Close();
             }
             m_socketAddresses.clear();
+            // DoInitialize installs them again on DoStart.
+            m_networkRoutes.Clear();
+            m_linkLocalRoutes.clear();
             m_helloTimer.Cancel();
-            m_olsrCheck.Cancel();
+            m_sweepTimer.Cancel();
+            m_queuedMessagesTimer.Cancel();
+            m_triggeredHello.Cancel();
+            m_running = false;
             forward = false;
         }
         void RoutingProtocol::DoStart() {
+            if (m_running) {
+                return;
+            }
             DoInitialize();
         }
         Ptr<Ipv4Route>
         RoutingProtocol::RouteOutput(Ptr<Packet> p, const Ipv4Header &header, Ptr<NetDevice> oif, Socket::SocketErrno & sockerr) {
             Ptr<Ipv4Route> rtentry = 0;
             if (header.GetDestination().IsMulticast()) {
-                NS_LOG_LOGIC("RouteOutput()::Multicast destination");
+                AIMF_DATAPATH_LOG_LOGIC("RouteOutput()::Multicast destination");
             }
             rtentry = LookupStatic(header.GetDestination(), oif);
             if (rtentry) {
@@ -482,26 +601,41 @@ namespace ns3 {
                 const Ipv4Header &header, Ptr<const NetDevice> idev,
                 UnicastForwardCallback ucb, MulticastForwardCallback mcb,
                 LocalDeliverCallback lcb, ErrorCallback ecb) {
-            NS_LOG_FUNCTION(this << p << header << header.GetSource() << header.GetDestination() << idev << &ucb << &mcb << &lcb << &ecb);
+            AIMF_DATAPATH_LOG_FUNCTION(this << p << header << header.GetSource() << header.GetDestination() << idev << &ucb << &mcb << &lcb << &ecb);
             NS_ASSERT(m_ipv4 != 0);
+            int32_t interface = m_ipv4->GetInterfaceForDevice(idev);
             // Check if input device supports IP 
-            NS_ASSERT(m_ipv4->GetInterfaceForDevice(idev) >= 0);
+            NS_ASSERT(interface >= 0);
             if (header.GetDestination().IsMulticast()) {
-                NS_LOG_LOGIC("Multicast destination");
-                Ptr<Ipv4MulticastRoute> mrtentry = LookupStatic(header.GetSource(),
-                        header.GetDestination(), m_ipv4->GetInterfaceForDevice(idev), header.GetTtl());
-                if (mrtentry) {
-                    m_rxMcastPacketTrace(p->Copy(), m_ipv4, idev->GetIfIndex());
-                    NS_LOG_LOGIC("Multicast rute ok");
-                    if (!forward) {
+                if (m_forwardingEntries == 0) {
+                    // Standby: the packet is only accounted, so skip the lookup bookkeeping and logging.
+                    const MulticastFibEntry *fib = FindEntry(header.GetSource(), header.GetDestination());
+                    if (fib != NULL && fib->entry.GetInputInterface() == (uint32_t) interface) {
+                        fib->packets++;
+                        fib->bytes += p->GetSize();
+                        m_rxMcastPacketTrace(p, m_ipv4, idev->GetIfIndex());
+                    }
+                    return false;
+                }
+                AIMF_DATAPATH_LOG_LOGIC("Multicast destination");
+                const MulticastFibEntry *fib = LookupStatic(header.GetSource(),
+                        header.GetDestination(), interface, header.GetTtl());
+                if (fib) {
+                    // Turned into activity state and rates by SampleActivity.
+                    fib->packets++;
+                    fib->bytes += p->GetSize();
+                    // The sinks get a const packet, no need to copy it.
+                    m_rxMcastPacketTrace(p, m_ipv4, idev->GetIfIndex());
+                    AIMF_DATAPATH_LOG_LOGIC("Multicast rute ok");
+                    if (!fib->forward) {
                         return false;
                     }
-                    mcb(mrtentry, p, header);
-                    m_txMcastPacketTrace(p->Copy(), m_ipv4, idev->GetIfIndex());
-                    NS_LOG_DEBUG("Packet routed with destination: " << header.GetDestination() << " and source: " << header.GetSource() << " Will = " << (int) m_willingness << " . It has a TTl of " << int (header.GetTtl()) << "---------------------------------------------------------------------------------------------");
+                    mcb(fib->mroute, p, header);
+                    m_txMcastPacketTrace(p, m_ipv4, idev->GetIfIndex());
+                    AIMF_DATAPATH_LOG_DEBUG("Packet routed with destination: " << header.GetDestination() << " and source: " << header.GetSource() << " Will = " << (int) m_willingness << " . It has a TTl of " << int (header.GetTtl()) << "---------------------------------------------------------------------------------------------");
                     return true;
                 } else {
-                    NS_LOG_LOGIC("Multicast rute er ikke funnet");
+                    AIMF_DATAPATH_LOG_LOGIC("Multicast rute er ikke funnet");
                     return false;
                 }
             }
@@ -523,22 +657,51 @@ namespace ns3 {
         }
         void
         RoutingProtocol::NotifyInterfaceDown(uint32_t i) {
+            m_linkLocalRoutes.clear();
         }
         void
         RoutingProtocol::NotifyAddAddress(uint32_t interface, Ipv4InterfaceAddress address) {
+            m_linkLocalRoutes.clear();
         }
         void
         RoutingProtocol::NotifyRemoveAddress(uint32_t interface, Ipv4InterfaceAddress address) {
+            m_linkLocalRoutes.clear();
         }
         std::vector<Ipv4MulticastRoutingTableEntry>
         RoutingProtocol::GetRoutingTableEntries() const {
             std::vector<Ipv4MulticastRoutingTableEntry> retval;
-            for (std::map<Ipv4Address, Ipv4MulticastRoutingTableEntry>::const_iterator iter = m_table.begin();
+            for (MulticastFib::const_iterator iter = m_table.begin();
                     iter != m_table.end(); iter++) {
-                retval.push_back(iter->second);
+                retval.push_back(iter->second.entry);
             }
             return retval;
         }
+        bool
+        RoutingProtocol::LookupRoutingTableEntry(const Ipv4Address &origin, const Ipv4Address &group,
+                Ipv4MulticastRoutingTableEntry &entry) const {
+            const MulticastFibEntry *fib = FindEntry(origin, group);
+            if (fib == NULL) {
+                return false;
+            }
+            entry = fib->entry;
+            return true;
+        }
+        const std::vector<uint8_t> &
+        RoutingProtocol::GetGroupPrefixLengths() const {
+            return m_groupPrefixLengths;
+        }
+        uint32_t
+        RoutingProtocol::GetMalformedPackets() const {
+            return m_malformedPackets;
+        }
+        uint32_t
+        RoutingProtocol::GetNUnicastRoutes() const {
+            return m_networkRoutes.GetNRoutes();
+        }
+        bool
+        RoutingProtocol::HasUnicastRoute(const Ipv4Address &dest) const {
+            return m_networkRoutes.Lookup(dest, Ipv4::IF_ANY) != NULL;
+        }
         int64_t
         RoutingProtocol::AssignStreams(int64_t stream) {
             NS_LOG_FUNCTION(this << stream);
@@ -548,24 +711,37 @@ namespace ns3 {
         void
         RoutingProtocol::PrintRoutingTable(Ptr<OutputStreamWrapper> stream) const {
             std::ostream* os = stream->GetStream();
-            *os << "Source\t\tGroup\t\tInterface\tDistance\n";
-            for (std::map<Ipv4Address, Ipv4MulticastRoutingTableEntry>::const_iterator iter = m_table.begin();
+            *os << "Source\t\tGroup\t\tInterface\tDistance\tRate (packets/s)\n";
+            for (MulticastFib::const_iterator iter = m_table.begin();
                     iter != m_table.end(); iter++) {
-                *os << iter->second.GetOrigin() << "\t\t";
-                *os << iter->second.GetGroup() << "\t\t";
-                if (Names::FindName(m_ipv4->GetNetDevice(iter->second.GetInputInterface())) != "") {
-                    *os << Names::FindName(m_ipv4->GetNetDevice(iter->second.GetInputInterface())) << "\t\t";
+                *os << iter->second.entry.GetOrigin() << "\t\t";
+                *os << iter->second.entry.GetGroup();
+                if (iter->first.groupPrefixLength != AIMF_SINGLE_GROUP_PREFIX) {
+                    *os << "/" << (int) iter->first.groupPrefixLength;
+                }
+                *os << "\t\t";
+                if (Names::FindName(m_ipv4->GetNetDevice(iter->second.entry.GetInputInterface())) != "") {
+                    *os << Names::FindName(m_ipv4->GetNetDevice(iter->second.entry.GetInputInterface())) << "\t\t";
                 } else {
-                    *os << iter->second.GetInputInterface() << "\t\t";
+                    *os << iter->second.entry.GetInputInterface() << "\t\t";
                 }
-                *os << iter->second.GetNOutputInterfaces() << "\t";
+                *os << iter->second.entry.GetNOutputInterfaces() << "\t\t";
+                *os << iter->second.packetRate;
                 *os << "\n";
             }
         }
         void RoutingProtocol::ChangeWillingness(uint8_t will) {
+            bool demoted = will < m_willingness;
             m_willingness = will;
             m_lastwill = will;
-            SendHello();
+            ResetHelloInterval();
+            if (demoted && m_running) {
+                // Another gateway may have to take over, don't make it wait for a jittered HELLO.
+                SendGoodbye(false);
+            } else {
+                TriggerHello();
+            }
+            ForwarderElection();
         }
         void RoutingProtocol::DoInitialize() {
             Ipv4Address loopback("127.0.0.1");
@@ -605,73 +781,147 @@ namespace ns3 {
                 m_mainAddress = m_ipv4->GetAddress(i, 0).GetLocal();
                 NS_LOG_DEBUG("Starting AIMF on node " << m_mainAddress);
                 canRunAimf = true;
-                Ipv4RoutingTableEntry * defMcRoute = new Ipv4RoutingTableEntry();
-                *defMcRoute = Ipv4RoutingTableEntry::CreateHostRouteTo(Ipv4Address(AIMF_MCAST_ADR), i);
-                m_networkRoutes.push_back(make_pair<Ipv4RoutingTableEntry*, uint32_t>(defMcRoute, 1));
+                m_networkRoutes.Insert(Ipv4RoutingTableEntry::CreateHostRouteTo(Ipv4Address(AIMF_MCAST_ADR), i), 1);
             }
             if (canRunAimf) {
+                // Reinstall the entries of the associations kept across DoStop.
+                RoutingTableComputation();
+                // Start with the full association set.
+                m_resyncRequested = true;
+                m_currentHelloInterval = m_helloInterval;
+                NS_ABORT_MSG_UNLESS(m_maxJitter < m_helloInterval, "MaxJitter must be below HelloInterval");
                 m_uniformRandomVariable2->SetStream(m_mainAddress.Get());
-                HelloTimerExpire();
-                Simulator::Schedule(Time(Simulator::Now() + Seconds(10)), &RoutingProtocol::OlsrTimerExpire, this);
-                forward = true;
+                // Gateways started together must not send their HELLOs together.
+                m_helloTimer.Schedule(Jitter());
+                m_sweepTimer.Schedule(m_sweepInterval);
+                m_lastActivitySample = Simulator::Now();
+                m_running = true;
+                UpdateOlsrReachability();
+                ForwarderElection();
                 NS_LOG_DEBUG("AIMF on node " << m_mainAddress << " started");
             }
         }
         void
-        RoutingProtocol::AssociationTupleTimerExpire(Ipv4Address advertiser, Ipv4Address group, Ipv4Address source) {
-            AssociationTuple *tuple = m_state.FindAssociationTuple(advertiser, group, source);
-            if (tuple == NULL) {
-                return;
+        RoutingProtocol::SweepTimerExpire() {
+            Time now = Simulator::Now();
+            // Collect first, erasing while iterating the hashed sets is not allowed.
+            std::vector<AssociationTuple> expiredTuples;
+            AssociationSet &associationSet = m_state.GetAssociationSet();
+            for (AssociationSet::iterator it = associationSet.begin(); it != associationSet.end(); it++) {
+                AssociationTuple &tuple = it->second;
+                const NeighborTuple *neighbor = m_state.FindNeighborTuple(tuple.advertiser);
+                if (neighbor != NULL && tuple.expirationTime < neighbor->expirationTime
+                        && ((neighbor->synced && neighbor->ansn == tuple.ansn)
+                        || (neighbor->pendingFragments > 0 && neighbor->pendingAnsn == tuple.ansn))) {
+                    // The advertiser still announces, or is still sending, the
+                    // set that carried the tuple.
+                    tuple.expirationTime = neighbor->expirationTime;
+                }
+                if (tuple.expirationTime < now) {
+                    expiredTuples.push_back(tuple);
+                }
             }
-            if (tuple->expirationTime < Simulator::Now()) {
-                RemoveAssociationTuple(*tuple);
-            } else {
-                m_events.Track(Simulator::Schedule(DELAY(tuple->expirationTime),
-                        &RoutingProtocol::AssociationTupleTimerExpire,
-                        this, advertiser, group, source));
+            for (std::vector<AssociationTuple>::const_iterator it = expiredTuples.begin(); it != expiredTuples.end(); it++) {
+                NS_LOG_DEBUG(now.GetSeconds() << "s AIMF node " << m_mainAddress << " expires " << *it);
+                RemoveAssociationTuple(*it);
+            }
+
+            std::vector<Ipv4Address> lost;
+            for (NeighborSet::const_iterator it = m_state.GetNeighbors().begin(); it != m_state.GetNeighbors().end(); it++) {
+                if (it->second.expirationTime < now) {
+                    lost.push_back(it->first);
+                }
             }
+            for (std::vector<Ipv4Address>::const_iterator it = lost.begin(); it != lost.end(); it++) {
+                NS_LOG_DEBUG(now.GetSeconds() << "s AIMF node " << m_mainAddress << " erasing node " << *it);
+                m_state.EraseNeighborTuple(*it);
+                m_neighborLost(*it);
+            }
+
+            SampleActivity(now);
+
+            if (!lost.empty()) {
+                ResetHelloInterval();
+                ForwarderElection();
+            }
+            NotifyTableChange();
+            m_sweepTimer.Schedule(m_sweepInterval);
         }
         void
         RoutingProtocol::RemoveAssociationTuple(const AssociationTuple &tuple) {
+            SourceGroup key = {tuple.source, tuple.group, tuple.groupPrefixLength};
             m_state.EraseAssociationTuple(tuple);
-            //RemoveEntry(tuple.group);
+            ReleaseEntry(key);
         }
         void
         RoutingProtocol::AddAssociationTuple(const AssociationTuple &tuple) {
+            SourceGroup key = {tuple.source, tuple.group, tuple.groupPrefixLength};
             m_state.InsertAssociationTuple(tuple);
+            AcquireEntry(key);
+        }
+        void
+        RoutingProtocol::ReceiveFragment(NeighborTuple &neighbor, const aimf::HelloView &hello) {
+            if (neighbor.synced && neighbor.ansn == hello.ansn) {
+                return;
+            }
+            if (neighbor.pendingFragments != hello.fragments || neighbor.pendingAnsn != hello.ansn) {
+                // A new set, whatever came of the previous one is stale.
+                neighbor.pendingAnsn = hello.ansn;
+                neighbor.pendingFragments = hello.fragments;
+                std::fill(neighbor.receivedFragments, neighbor.receivedFragments + 8, 0);
+            }
+            SetFragmentReceived(neighbor, hello.fragment);
+            uint8_t fragment = 0;
+            while (fragment < hello.fragments && IsFragmentReceived(neighbor, fragment)) {
+                fragment++;
+            }
+            if (fragment == hello.fragments) {
+                neighbor.ansn = hello.ansn;
+                neighbor.synced = true;
+                neighbor.pendingFragments = 0;
+            } else if (hello.fragment == hello.fragments - 1) {
+                // The burst is over, anything missing by now was lost.
+                SendResync(neighbor, hello.ansn);
+            }
         }
         void
-        RoutingProtocol::ProcessHello(const aimf::MessageHeader &msg,
+        RoutingProtocol::ProcessHello(const aimf::MessageView &msg,
+                const aimf::HelloView &hello,
                 const Ipv4Address &receiverIface,
                 const Ipv4Address & senderIface) {
-            NS_LOG_FUNCTION(msg << receiverIface << senderIface);
-            const aimf::MessageHeader::Hello &hello = msg.GetHello();
-#ifdef NS3_LOG_ENABLE
+            NS_LOG_FUNCTION(msg.originatorAddress << receiverIface << senderIface);
             Time now = Simulator::Now();
+            Time vTime = msg.GetVTime();
             // 2. For each (group, source) pair in the
-            // message:
-            for (std::vector<aimf::MessageHeader::Hello::Association>::const_iterator it = hello.associations.begin();
-                    it != hello.associations.end(); it++) {
-                AssociationTuple *tuple = m_state.FindAssociationTuple(msg.GetOriginatorAddress(), it->group, it->source);
+            // message (a HELLO without FULL carries none):
+            uint32_t offset = 0;
+            for (uint32_t n = 0; n < hello.nAssociations; n++) {
+                aimf::MessageHeader::Hello::Association association = hello.ReadAssociation(offset);
+                AssociationTuple *tuple = m_state.FindAssociationTuple(msg.originatorAddress,
+                        association.group, association.groupPrefixLength, association.source);
                 if (tuple != NULL) {
-                    tuple->expirationTime = now + msg.GetVTime();
+                    tuple->expirationTime = now + vTime;
+                    tuple->ansn = hello.ansn;
+                    if (tuple->will != association.willGroupSSM) {
+                        tuple->will = association.willGroupSSM;
+                        SourceGroup key = {tuple->source, tuple->group, tuple->groupPrefixLength};
+                        ElectEntry(key);
+                    }
                 } else {
                     AssociationTuple assocTuple = {
-                        msg.GetOriginatorAddress(),
-                        it->group,
-                        it->source,
-                        now + msg.GetVTime(),
-                        it->willGroupSSM
+                        msg.originatorAddress,
+                        association.group,
+                        association.groupPrefixLength,
+                        association.source,
+                        now + vTime,
+                        association.willGroupSSM,
+                        hello.ansn
                     };
+                    // Removed by SweepTimerExpire once expired.
                     AddAssociationTuple(assocTuple);
-                    //Schedule Association Tuple deletion
-                    Simulator::Schedule(DELAY(assocTuple.expirationTime),
-                            &RoutingProtocol::AssociationTupleTimerExpire, this,
-                            assocTuple.advertiser, assocTuple.group, assocTuple.source);
                 }
             }
-#endif // NS3_LOG_ENABLE
-            PopulateNeighborSet(msg, now);
+            PopulateNeighborSet(msg, hello, now);
         }
         void RoutingProtocol::SetInterfaceExclusions(std::set<uint32_t> exceptions) {
             m_interfaceExclusions = exceptions;
@@ -684,83 +934,227 @@ namespace ns3 {
             m_state.InsertNeighborTuple(tuple);
         }
         void
-        RoutingProtocol::PopulateNeighborSet(const aimf::MessageHeader &msg,
+        RoutingProtocol::PopulateNeighborSet(const aimf::MessageView &msg,
+                const aimf::HelloView &hello,
                 const Time & now) {
-            NS_LOG_DEBUG("received willingness " << int(msg.GetHello().willingness) << " from " << msg.GetOriginatorAddress());
-            NeighborTuple *tuple = m_state.FindNeighborTuple(msg.GetOriginatorAddress());
+            NS_LOG_DEBUG("received willingness " << int(hello.willingness) << " from " << msg.originatorAddress);
+            // The neighbor holds its next HELLO back for at most Htime.
+            Time holdTime = Time(AIMF_NEIGHB_HOLD_FACTOR * hello.GetHTime());
+            NeighborTuple *tuple = m_state.FindNeighborTuple(msg.originatorAddress);
             if (tuple != NULL) {
                 NS_LOG_DEBUG(Simulator::Now().GetSeconds()
                         << "s AIMF node " << m_mainAddress
-                        << " updating " << tuple->neighborMainAddr << "'s expiration time from " << tuple->expirationTime.GetSeconds() << " to " << ((Time) now + msg.GetVTime()).GetSeconds());
-                tuple->expirationTime = now + msg.GetVTime();
-                tuple->willingness = msg.GetHello().willingness;
+                        << " updating " << tuple->neighborMainAddr << "'s expiration time from " << tuple->expirationTime.GetSeconds() << " to " << ((Time) now + holdTime).GetSeconds());
+                tuple->expirationTime = now + holdTime;
+                if (tuple->willingness != hello.willingness) {
+                    m_state.SetNeighborWillingness(*tuple, hello.willingness);
+                    ResetHelloInterval();
+                    ForwarderElection();
+                }
+                if (tuple->synced && tuple->ansn != hello.ansn) {
+                    ResetHelloInterval();
+                }
+                if (hello.IsFull()) {
+                    ReceiveFragment(*tuple, hello);
+                } else if (!tuple->synced || tuple->ansn != hello.ansn) {
+                    // The association set changed and we missed the full HELLO.
+                    SendResync(*tuple, hello.ansn);
+                }
             } else {
-                NeighborTuple nb_tuple = {msg.GetOriginatorAddress()
-                    , now + msg.GetVTime(), msg.GetHello().willingness};
+                // Not synced to any set until every fragment of one came.
+                NeighborTuple nb_tuple = {msg.originatorAddress
+                    , now + holdTime, hello.willingness, hello.ansn, false, 0, 0};
+                if (hello.IsFull()) {
+                    ReceiveFragment(nb_tuple, hello);
+                } else {
+                    SendResync(nb_tuple, hello.ansn);
+                }
                 AddNeigbour(nb_tuple);
                 NS_LOG_DEBUG(Simulator::Now().GetSeconds()
                         << "s AIMF node " << m_mainAddress
-                        << " adding " << nb_tuple.neighborMainAddr << " as neighbour. Scheduled for removal at: " << nb_tuple.expirationTime.GetSeconds());
-                Simulator::Schedule(DELAY(nb_tuple.expirationTime), &RoutingProtocol::RemoveNeighborset, this, nb_tuple.neighborMainAddr);
+                        << " adding " << nb_tuple.neighborMainAddr << " as neighbour. Expires at: " << nb_tuple.expirationTime.GetSeconds());
+                ResetHelloInterval();
+                UpdateOlsrReachability();
+                ForwarderElection();
             }
         }
         void
-        RoutingProtocol::RemoveNeighborset(Ipv4Address adress) {
-            NS_LOG_DEBUG(Simulator::Now().GetSeconds()
-                    << "s AIMF node " << m_mainAddress
-                    << " erasing node " << adress);
-            NeighborTuple *tuple = m_state.FindNeighborTuple(adress);
-            if (tuple == NULL) {
-                return;
+        RoutingProtocol::Clear() {
+            NS_LOG_FUNCTION_NOARGS();
+            m_table.clear();
+            m_forwardingEntries = 0;
+            for (uint8_t i = 0; i <= AIMF_SINGLE_GROUP_PREFIX; i++) {
+                m_groupPrefixEntries[i] = 0;
             }
-            if (tuple->expirationTime < Simulator::Now()) {
-                m_state.EraseNeighborTuple(adress);
-            } else {
-                m_events.Track(Simulator::Schedule(DELAY(tuple->expirationTime), &RoutingProtocol::RemoveNeighborset, this, tuple->neighborMainAddr));
+            m_groupPrefixLengths.clear();
+        }
+        void
+        RoutingProtocol::RemoveEntry(const SourceGroup &key) {
+            MulticastFib::iterator it = m_table.find(key);
+            if (it != m_table.end()) {
+                SetEntryForward(it->second, false);
+                m_table.erase(it);
+                CountGroupPrefix(key.groupPrefixLength, false);
             }
         }
         void
-        RoutingProtocol::Clear() {
-            NS_LOG_FUNCTION_NOARGS();
-            m_table.clear();
+        RoutingProtocol::CountGroupPrefix(uint8_t length, bool added) {
+            uint32_t &count = m_groupPrefixEntries[length];
+            count = added ? count + 1 : count - 1;
+            if (length == AIMF_SINGLE_GROUP_PREFIX || count > (added ? 1u : 0u)) {
+                return;
+            }
+            // A length appeared or disappeared, rebuild the short list FindEntry walks.
+            m_groupPrefixLengths.clear();
+            for (int32_t i = AIMF_SINGLE_GROUP_PREFIX - 1; i >= 0; i--) {
+                if (m_groupPrefixEntries[i] > 0) {
+                    m_groupPrefixLengths.push_back(i);
+                }
+            }
         }
         void
-        RoutingProtocol::RemoveEntry(Ipv4Address const &group) {
-            m_table.erase(group);
+        RoutingProtocol::SetEntryForward(MulticastFibEntry &fib, bool forward) {
+            if (fib.forward == forward) {
+                return;
+            }
+            fib.forward = forward;
+            if (forward) {
+                m_forwardingEntries++;
+            } else {
+                m_forwardingEntries--;
+            }
         }
         void
-        RoutingProtocol::AddEntry(Ipv4Address const &group,
-                Ipv4Address const &source,
+        RoutingProtocol::AddEntry(const SourceGroup &key,
                 uint32_t inputInterface,
                 std::vector<uint32_t> outputInterfaces) {
-            NS_LOG_FUNCTION(this << group << source << m_mainAddress);
+            NS_LOG_FUNCTION(this << key << m_mainAddress);
             NS_ASSERT(m_ipv4);
-            Ipv4MulticastRoutingTableEntry &entry = m_table[group];
-            entry = entry.CreateMulticastRoute(source, group, inputInterface, outputInterfaces);
+            const Ipv4Address &group = key.group;
+            const Ipv4Address &source = key.source;
+            MulticastFibEntry &fib = m_table[key];
+            fib.entry = Ipv4MulticastRoutingTableEntry::CreateMulticastRoute(source, group, inputInterface, outputInterfaces);
+            // Build the route once here, LookupStatic hands it out as is until the entry changes.
+            Ptr<Ipv4MulticastRoute> mrtentry = Create<Ipv4MulticastRoute> ();
+            mrtentry->SetGroup(group);
+            mrtentry->SetOrigin(source);
+            mrtentry->SetParent(inputInterface);
+            for (uint32_t j = 0; j < fib.entry.GetNOutputInterfaces(); j++) {
+                if (fib.entry.GetOutputInterface(j)) {
+                    NS_LOG_LOGIC("Setting output interface index " << fib.entry.GetOutputInterface(j));
+                    mrtentry->SetOutputTtl(fib.entry.GetOutputInterface(j), Ipv4MulticastRoute::MAX_TTL - 1);
+                }
+            }
+            fib.mroute = mrtentry;
+        }
+        void
+        RoutingProtocol::AcquireEntry(const SourceGroup &key) {
+            MulticastFib::iterator it = m_table.find(key);
+            if (it == m_table.end()) {
+                std::vector<uint32_t> outint(m_netdevice.begin(), m_netdevice.end());
+                AddEntry(key, m_ipv4->GetInterfaceForAddress(m_mainAddress), outint);
+                CountGroupPrefix(key.groupPrefixLength, true);
+                NS_LOG_DEBUG("Node " << m_mainAddress << ": Adding " << key << " to routing table.");
+                it = m_table.find(key);
+                MulticastFibEntry &fib = it->second;
+                fib.refs = 0;
+                fib.forward = false;
+                fib.packets = fib.bytes = 0;
+                fib.sampledPackets = fib.sampledBytes = 0;
+                fib.packetRate = fib.byteRate = 0;
+                fib.spotted = false;
+                RecordTableChange(key, true);
+            }
+            it->second.refs++;
+            // A new advertiser may change who is the designated forwarder.
+            SetEntryForward(it->second, IsEntryForwarder(key));
+        }
+        void
+        RoutingProtocol::ReleaseEntry(const SourceGroup &key) {
+            MulticastFib::iterator it = m_table.find(key);
+            if (it == m_table.end()) {
+                return;
+            }
+            if (--it->second.refs == 0) {
+                NS_LOG_DEBUG("Node " << m_mainAddress << ": Removing " << key << " from routing table.");
+                SetEntryForward(it->second, false);
+                m_table.erase(it);
+                CountGroupPrefix(key.groupPrefixLength, false);
+                RecordTableChange(key, false);
+            } else {
+                SetEntryForward(it->second, IsEntryForwarder(key));
+            }
+        }
+        void
+        RoutingProtocol::ElectEntry(const SourceGroup &key) {
+            MulticastFib::iterator it = m_table.find(key);
+            if (it != m_table.end()) {
+                SetEntryForward(it->second, IsEntryForwarder(key));
+            }
+        }
+        void
+        RoutingProtocol::RecordTableChange(const SourceGroup &key, bool added) {
+            // An entry that comes and goes within one batch is no change at all.
+            std::vector<SourceGroup> &undo = added ? m_tableRemoved : m_tableAdded;
+            std::vector<SourceGroup>::iterator it = std::find(undo.begin(), undo.end(), key);
+            if (it != undo.end()) {
+                undo.erase(it);
+                return;
+            }
+            (added ? m_tableAdded : m_tableRemoved).push_back(key);
+        }
+        void
+        RoutingProtocol::NotifyTableChange() {
+            if (m_tableAdded.empty() && m_tableRemoved.empty()) {
+                return;
+            }
+            NS_LOG_DEBUG(Simulator::Now().GetSeconds() << " s: Node " << m_mainAddress
+                    << ": routing table changed, " << m_tableAdded.size() << " added, "
+                    << m_tableRemoved.size() << " removed.");
+            m_routingTableDelta(m_tableAdded, m_tableRemoved);
+            m_routingTableChanged(m_table.size());
+            m_tableAdded.clear();
+            m_tableRemoved.clear();
         }
         void
         RoutingProtocol::RoutingTableComputation() {
             NS_LOG_DEBUG(Simulator::Now().GetSeconds() << " s: Node " << m_mainAddress
                     << ": RoutingTableComputation begin...");
-            Clear();
-            std::vector<uint32_t> outint(m_netdevice.size() - 1);
-            std::copy(m_netdevice.begin(), m_netdevice.end(), std::back_inserter(outint));
+            // Count the references every (S,G) should have according to the state ...
+            std::tr1::unordered_map<SourceGroup, uint32_t, SourceGroupHash> wanted;
             const Associations &localHmaAssociations = m_state.GetAssociations();
             for (Associations::const_iterator assocIterator = localHmaAssociations.begin();
                     assocIterator != localHmaAssociations.end(); assocIterator++) {
-                Association const &localHmaAssoc = *assocIterator;
-                AddEntry(localHmaAssoc.group, localHmaAssoc.source, m_ipv4->GetInterfaceForAddress(m_mainAddress), outint);
-                NS_LOG_DEBUG("Node " << m_mainAddress << ": Adding local (" << localHmaAssoc.group << "," << localHmaAssoc.source << ") pair to routing table. OuputInterface is: " << m_ipv4->GetAddress(outint.front(), 0).GetLocal() << " and Input is: " << m_ipv4->GetAddress(1, 0).GetLocal());
+                SourceGroup key = {assocIterator->source, assocIterator->group, assocIterator->groupPrefixLength};
+                wanted[key]++;
             }
             const AssociationSet &localHmaAssociationSets = m_state.GetAssociationSet();
             for (AssociationSet::const_iterator assocSetIterator = localHmaAssociationSets.begin();
                     assocSetIterator != localHmaAssociationSets.end(); assocSetIterator++) {
-                AssociationTuple const &localHmaAssocSet = *assocSetIterator;
-                AddEntry(localHmaAssocSet.group, localHmaAssocSet.source, m_ipv4->GetInterfaceForAddress(m_mainAddress), outint);
-                NS_LOG_DEBUG("Node " << m_mainAddress << ": Adding adjacent (" << localHmaAssocSet.group << "," << localHmaAssocSet.source << ") pair to routing table. OuputInterface is: " << m_ipv4->GetAddress(outint.front(), 0).GetLocal() << " and Input is: " << m_ipv4->GetAddress(1, 0).GetLocal());
+                const AssociationTuple &tuple = assocSetIterator->second;
+                SourceGroup key = {tuple.source, tuple.group, tuple.groupPrefixLength};
+                wanted[key]++;
+            }
+            // ... and only touch the entries that differ.
+            for (MulticastFib::iterator it = m_table.begin(); it != m_table.end();) {
+                if (wanted.find(it->first) == wanted.end()) {
+                    RecordTableChange(it->first, false);
+                    SetEntryForward(it->second, false);
+                    CountGroupPrefix(it->first.groupPrefixLength, false);
+                    it = m_table.erase(it);
+                } else {
+                    it++;
+                }
+            }
+            for (std::tr1::unordered_map<SourceGroup, uint32_t, SourceGroupHash>::const_iterator it = wanted.begin();
+                    it != wanted.end(); it++) {
+                if (m_table.find(it->first) == m_table.end()) {
+                    AcquireEntry(it->first);
+                }
+                m_table[it->first].refs = it->second;
             }
             NS_LOG_DEBUG("Node " << m_mainAddress << ": RoutingTableComputation end.");
-            m_routingTableChanged(m_table.size());
+            NotifyTableChange();
         }
         void
         RoutingProtocol::SendHello() {
@@ -771,17 +1165,135 @@ namespace ns3 {
             msg.SetTimeToLive(255);
             msg.SetMessageSequenceNumber(GetMessageSequenceNumber());
             MessageHeader::Hello &hello = msg.GetHello();
+            hello.SetHTime(m_currentHelloInterval);
             hello.willingness = m_willingness;
-            std::vector<aimf::MessageHeader::Hello::Association> &associations = hello.associations;
-            // Add all local HMA associations to the HMA message
-            const Associations &localHelloAssociations = m_state.GetAssociations();
-            for (Associations::const_iterator it = localHelloAssociations.begin();
-                    it != localHelloAssociations.end(); it++) {
-                aimf::MessageHeader::Hello::Association assoc = {it->group, it->source, it->will};
-                associations.push_back(assoc);
+            hello.ansn = m_ansn;
+            hello.flags = 0;
+            Time now = Simulator::Now();
+            if (!m_deltaHello || m_resyncRequested || m_fullHelloAnsn != m_ansn
+                    || now >= m_lastFullHello + m_fullHelloInterval) {
+                hello.flags |= MessageHeader::Hello::FULL;
+                m_fullHelloAnsn = m_ansn;
+                m_lastFullHello = now;
+                m_resyncRequested = false;
+                m_requestedFragments.clear();
+            }
+            if (!m_helloTemplateValid) {
+                // Add all local HMA associations to the HMA message
+                m_helloTemplate.ClearAssociations();
+                const Associations &localHelloAssociations = m_state.GetAssociations();
+                for (Associations::const_iterator it = localHelloAssociations.begin();
+                        it != localHelloAssociations.end(); it++) {
+                    aimf::MessageHeader::Hello::Association assoc = {it->group, it->groupPrefixLength, it->source, it->will};
+                    m_helloTemplate.AddAssociation(assoc);
+                }
+                m_helloTemplateValid = true;
+            }
+            // A large association set is split so that no HELLO needs IP
+            // fragmentation, one lost fragment would lose all of it.
+            uint32_t maxSize = GetMaxPacketSize() - aimf::PacketHeader().GetSerializedSize();
+            std::set<uint8_t> fragments;
+            if (hello.IsFull()) {
+                hello.fragments = m_helloTemplate.GetNFragments(maxSize);
+                for (uint8_t fragment = 0; fragment < hello.fragments; fragment++) {
+                    fragments.insert(fragment);
+                }
+            } else if (!m_requestedFragments.empty()) {
+                // Resend only what neighbors lost of the current set.
+                hello.flags |= MessageHeader::Hello::FULL;
+                hello.fragments = m_helloTemplate.GetNFragments(maxSize);
+                fragments.swap(m_requestedFragments);
+            } else {
+                hello.fragments = 1;
+                fragments.insert(0);
+            }
+            for (std::set<uint8_t>::const_iterator it = fragments.begin(); it != fragments.end(); it++) {
+                if (it != fragments.begin()) {
+                    msg.SetMessageSequenceNumber(GetMessageSequenceNumber());
+                }
+                hello.fragment = *it;
+                // Only the header fields are written, the records stay from the last change.
+                uint32_t size = m_helloTemplate.AppendMessage(msg, maxSize, m_queuedMessages);
+                m_queuedMessageSizes.push_back(size);
+                NS_LOG_DEBUG("AIMF HELLO message size: " << size);
+            }
+            ScheduleQueuedMessages();
+        }
+        void
+        RoutingProtocol::SendResync(const NeighborTuple &neighbor, uint16_t ansn) {
+            aimf::MessageHeader msg;
+            msg.SetVTime(AIMF_NEIGHB_HOLD_TIME);
+            msg.SetOriginatorAddress(m_mainAddress);
+            msg.SetTimeToLive(1);
+            msg.SetMessageSequenceNumber(GetMessageSequenceNumber());
+            aimf::MessageHeader::Resync &resync = msg.GetResync();
+            resync.target = neighbor.neighborMainAddr;
+            resync.ansn = ansn;
+            resync.fragments = 0;
+            resync.missing.clear();
+            if (neighbor.pendingFragments > 0 && neighbor.pendingAnsn == ansn) {
+                resync.fragments = neighbor.pendingFragments;
+                for (uint8_t fragment = 0; fragment < neighbor.pendingFragments; fragment++) {
+                    if (!IsFragmentReceived(neighbor, fragment)) {
+                        resync.missing.push_back(fragment);
+                    }
+                }
+            }
+            NS_LOG_DEBUG(Simulator::Now().GetSeconds() << "s AIMF node " << m_mainAddress
+                    << " asks " << resync.target << " for " << (resync.IsWholeSet() ? "its association set"
+                    : "missing fragments") << " of ANSN " << ansn);
+            QueueMessage(msg);
+        }
+        void
+        RoutingProtocol::ProcessResync(const aimf::MessageHeader::Resync &resync) {
+            if (resync.target != m_mainAddress) {
+                return;
             }
-            NS_LOG_DEBUG("AIMF HELLO message size: " << int (msg.GetSerializedSize()));
-            SendMessage(msg);
+            uint32_t maxSize = GetMaxPacketSize() - aimf::PacketHeader().GetSerializedSize();
+            if (!resync.IsWholeSet() && resync.ansn == m_ansn && m_helloTemplateValid
+                    && resync.fragments == m_helloTemplate.GetNFragments(maxSize)) {
+                // Requests until the triggered HELLO leaves are merged.
+                m_requestedFragments.insert(resync.missing.begin(), resync.missing.end());
+            } else {
+                // The neighbor asks for a set we no longer have, send the current one.
+                m_resyncRequested = true;
+            }
+            TriggerHello();
+        }
+        void
+        RoutingProtocol::SendGoodbye(bool withdraw) {
+            NS_LOG_DEBUG(Simulator::Now().GetSeconds() << "s AIMF node " << m_mainAddress
+                    << " says goodbye, willingness " << (int) m_willingness << (withdraw ? ", withdrawing." : "."));
+            aimf::MessageHeader msg;
+            msg.SetVTime(AIMF_NEIGHB_HOLD_TIME);
+            msg.SetOriginatorAddress(m_mainAddress);
+            msg.SetTimeToLive(1);
+            msg.SetMessageSequenceNumber(GetMessageSequenceNumber());
+            aimf::MessageHeader::Goodbye &goodbye = msg.GetGoodbye();
+            goodbye.willingness = m_willingness;
+            goodbye.flags = withdraw ? aimf::MessageHeader::Goodbye::WITHDRAW : 0;
+            QueueMessage(msg);
+        }
+        void
+        RoutingProtocol::ProcessGoodbye(const aimf::MessageView &msg,
+                const aimf::MessageHeader::Goodbye &goodbye) {
+            NeighborTuple *tuple = m_state.FindNeighborTuple(msg.originatorAddress);
+            if (tuple == NULL) {
+                return;
+            }
+            if (goodbye.IsWithdraw()) {
+                NS_LOG_DEBUG(Simulator::Now().GetSeconds() << "s AIMF node " << m_mainAddress
+                        << ": " << tuple->neighborMainAddr << " withdraws.");
+                // Its association tuples stay until they expire, so that
+                // another gateway takes over its groups.
+                m_state.EraseNeighborTuple(msg.originatorAddress);
+            } else if (tuple->willingness != goodbye.willingness) {
+                m_state.SetNeighborWillingness(*tuple, goodbye.willingness);
+            } else {
+                return;
+            }
+            ResetHelloInterval();
+            ForwarderElection();
         }
         void
         RoutingProtocol::SendPacket(Ptr<Packet> packet) {
@@ -796,10 +1308,9 @@ namespace ns3 {
                     m_socketAddresses.begin(); i != m_socketAddresses.end(); i++) {
                 Ipv4Address mcast = Ipv4Address(AIMF_MCAST_ADR);
                 NS_LOG_DEBUG("Using socket with  " << i->second.GetLocal() << " as src address.");
+                // Traced before the socket adds its headers, so no copy is needed.
+                m_txHelloPacketTrace(packet, m_ipv4, i->first->GetBoundNetDevice()->GetIfIndex());
                 i->first->SendTo(packet, 0, InetSocketAddress(mcast, AIMF_PORT_NUMBER));
-                Ptr<Packet> packetCopy;
-                packetCopy = packet->Copy();
-                m_txHelloPacketTrace(packetCopy, m_ipv4, i->first->GetBoundNetDevice()->GetIfIndex());
             }
         }
         uint16_t GetMessageSequenceNumber() {
@@ -807,86 +1318,325 @@ namespace ns3 {
             return m_messageSequenceNumber;
         }
         void
-        RoutingProtocol::SendMessage(const MessageHeader &message) {
+        RoutingProtocol::QueueMessage(const MessageHeader &message) {
             Ptr<Packet> packet = Create<Packet> ();
-            NS_LOG_DEBUG("Aimf node " << m_mainAddress << ": SendMessage");
-            Ptr<Packet> p = Create<Packet> ();
-            (*p).AddHeader(message);
-            packet->AddAtEnd(p);
-            SendPacket(packet);
+            packet->AddHeader(message);
+            uint32_t size = packet->GetSize();
+            uint32_t offset = m_queuedMessages.size();
+            m_queuedMessages.resize(offset + size);
+            packet->CopyData(&m_queuedMessages[offset], size);
+            m_queuedMessageSizes.push_back(size);
+            ScheduleQueuedMessages();
+        }
+        void
+        RoutingProtocol::ScheduleQueuedMessages() {
+            NS_LOG_DEBUG("Aimf node " << m_mainAddress << ": " << m_queuedMessageSizes.size() << " messages queued");
+            if (m_aggregationWindow.IsZero()) {
+                SendQueuedMessages();
+            } else if (!m_queuedMessagesTimer.IsRunning()) {
+                m_queuedMessagesTimer.Schedule(m_aggregationWindow);
+            }
         }
         void
+        RoutingProtocol::SendQueuedMessages() {
+            m_queuedMessagesTimer.Cancel();
+            uint32_t maxSize = GetMaxPacketSize() - aimf::PacketHeader().GetSerializedSize();
+            uint32_t begin = 0;
+            uint32_t size = 0;
+            for (std::vector<uint16_t>::const_iterator it = m_queuedMessageSizes.begin();
+                    it != m_queuedMessageSizes.end(); it++) {
+                if (size > 0 && size + *it > maxSize) {
+                    SendPacket(Create<Packet> (&m_queuedMessages[begin], size));
+                    begin += size;
+                    size = 0;
+                }
+                // A message larger than maxSize goes alone, IP fragments it.
+                size += *it;
+            }
+            if (size > 0) {
+                SendPacket(Create<Packet> (&m_queuedMessages[begin], size));
+            }
+            m_queuedMessages.clear();
+            m_queuedMessageSizes.clear();
+        }
+        uint32_t
+        RoutingProtocol::GetMaxPacketSize() const {
+            uint32_t size = 0xffff;
+            for (std::map<Ptr<Socket>, Ipv4InterfaceAddress>::const_iterator i =
+                    m_socketAddresses.begin(); i != m_socketAddresses.end(); i++) {
+                int32_t interface = m_ipv4->GetInterfaceForAddress(i->second.GetLocal());
+                if (interface >= 0) {
+                    size = std::min<uint32_t> (size, m_ipv4->GetMtu(interface) - AIMF_IP_UDP_HEADER_SIZE);
+                }
+            }
+            return size;
+        }
+        bool
+        RoutingProtocol::GetGroupPrefix(Ipv4Address &group, Ipv4Mask groupMask, uint8_t &length) const {
+            length = groupMask.GetPrefixLength();
+            if (GroupPrefixMask(length) != groupMask.Get()) {
+                NS_LOG_WARN("Group mask " << groupMask << " is not contiguous.");
+                return false;
+            }
+            Ipv4Address prefix = Ipv4Address(group.Get() & GroupPrefixMask(length));
+            if (!IsGroupPrefix(prefix.Get(), length)) {
+                NS_LOG_WARN("Group prefix " << prefix << "/" << (int) length << " is not within 224.0.0.0/4.");
+                return false;
+            }
+            group = prefix;
+            return true;
+        }
+        bool
         RoutingProtocol::AddHostMulticastAssociation(Ipv4Address group, Ipv4Address source) {
+            return AddHostMulticastPrefix(group, Ipv4Mask::GetOnes(), source);
+        }
+        bool
+        RoutingProtocol::AddHostMulticastPrefix(Ipv4Address group, Ipv4Mask groupMask, Ipv4Address source) {
+            uint8_t length;
+            if (!GetGroupPrefix(group, groupMask, length)) {
+                NS_LOG_WARN("Association of " << source << " to " << group << "/" << groupMask << " ignored.");
+                return false;
+            }
             // Check if the (group, source) tuple already exist
             // in the list of local HMA associations. IGMP was responsible for the function call.
-            const Associations &localHnaAssociations = m_state.GetAssociations();
-            for (Associations::const_iterator assocIterator = localHnaAssociations.begin();
-                    assocIterator != localHnaAssociations.end(); assocIterator++) {
-                Association const &localHnaAssoc = *assocIterator;
-                if (localHnaAssoc.group == group && localHnaAssoc.source == source) {
-                    NS_LOG_INFO("HMA association for multicast group (" << group << "," << source << ") already exists.");
-                    return;
-                }
+            if (m_state.FindAssociation(group, length, source) != NULL) {
+                NS_LOG_INFO("HMA association for multicast group (" << group << "/" << (int) length << ","
+                        << source << ") already exists.");
+                return true;
             }
             // If the tuple does not already exist, add it to the list of local HMA associations.
-            NS_LOG_INFO("Adding HMA association for multicast group (" << group << "," << source << ").");
-            uint8_t k = 64;
+            NS_LOG_INFO("Adding HMA association for multicast group (" << group << "/" << (int) length << ","
+                    << source << ").");
             m_state.InsertAssociation((Association) {
-                group, source, m_mainAddress, k
+                group, length, source, m_mainAddress, AIMF_WILL_INHERIT
             });
-            RoutingTableComputation();
+            m_ansn++;
+            m_helloTemplateValid = false;
+            ResetHelloInterval();
+            SourceGroup key = {source, group, length};
+            AcquireEntry(key);
+            NotifyTableChange();
+            return true;
+        }
+        void
+        RoutingProtocol::SetGroupWillingness(Ipv4Address group, Ipv4Address source, uint8_t will) {
+            SetGroupPrefixWillingness(group, Ipv4Mask::GetOnes(), source, will);
+        }
+        void
+        RoutingProtocol::SetGroupPrefixWillingness(Ipv4Address group, Ipv4Mask groupMask,
+                Ipv4Address source, uint8_t will) {
+            uint8_t length;
+            if (!GetGroupPrefix(group, groupMask, length)) {
+                return;
+            }
+            Association *assoc = m_state.FindAssociation(group, length, source);
+            if (assoc == NULL) {
+                NS_LOG_INFO("No HMA association for multicast group (" << group << "/" << (int) length << ","
+                        << source << ").");
+                return;
+            }
+            if (assoc->will == will) {
+                return;
+            }
+            assoc->will = will;
+            m_ansn++;
+            m_helloTemplateValid = false;
+            ResetHelloInterval();
+            SourceGroup key = {source, group, length};
+            ElectEntry(key);
+            // Let the other gateways rerun their election for this group.
+            TriggerHello();
         }
         void RoutingProtocol::RemoveHostMulticastAssociation(Ipv4Address group, Ipv4Address source) {
+            RemoveHostMulticastPrefix(group, Ipv4Mask::GetOnes(), source);
+        }
+        void RoutingProtocol::RemoveHostMulticastPrefix(Ipv4Address group, Ipv4Mask groupMask, Ipv4Address source) {
+            uint8_t length;
+            if (!GetGroupPrefix(group, groupMask, length)) {
+                return;
+            }
+            if (m_state.FindAssociation(group, length, source) == NULL) {
+                return;
+            }
             m_state.EraseAssociation((Association) {
-                group, source
+                group, length, source
             });
-            RoutingTableComputation();
-            m_state.EraseTimer(group);
+            m_ansn++;
+            m_helloTemplateValid = false;
+            ResetHelloInterval();
+            SourceGroup key = {source, group, length};
+            ReleaseEntry(key);
+            NotifyTableChange();
+        }
+        Time
+        RoutingProtocol::Jitter() {
+            return Seconds(m_uniformRandomVariable2->GetValue(0, m_maxJitter.GetSeconds()));
+        }
+        void
+        RoutingProtocol::TriggerHello() {
+            if (m_triggeredHello.IsRunning()) {
+                return;
+            }
+            m_triggeredHello = Simulator::Schedule(Jitter(), &RoutingProtocol::SendHello, this);
         }
         void
         RoutingProtocol::HelloTimerExpire() {
             SendHello();
-            m_helloTimer.Schedule(m_helloInterval);
+            // RFC 5148: periodic messages go out interval - jitter after the previous one.
+            m_helloTimer.Schedule(m_currentHelloInterval - Jitter());
+            if (m_adaptiveHello) {
+                // Nothing changed during the interval, back off.
+                m_currentHelloInterval = std::min(2 * m_currentHelloInterval, m_maxHelloInterval);
+            }
+        }
+        void
+        RoutingProtocol::ResetHelloInterval() {
+            if (!m_adaptiveHello || m_currentHelloInterval == m_helloInterval) {
+                return;
+            }
+            NS_LOG_DEBUG(Simulator::Now().GetSeconds() << "s AIMF node " << m_mainAddress
+                    << " resets its HELLO interval to " << m_helloInterval.GetSeconds() << "s.");
+            m_currentHelloInterval = m_helloInterval;
+            if (m_helloTimer.IsRunning() && m_helloTimer.GetDelayLeft() > m_helloInterval) {
+                m_helloTimer.Cancel();
+                m_helloTimer.Schedule(m_helloInterval - Jitter());
+            }
         }
-        void RoutingProtocol::OlsrTimerExpire() {
-            double t = 0;
-            uint8_t j = 0;
-            std::vector<olsr::RoutingTableEntry> v = m_olsr_onNode->GetRoutingTableEntries();
+        void
+        RoutingProtocol::OlsrRoutingTableChanged(uint32_t size) {
+            NS_LOG_DEBUG(Simulator::Now().GetSeconds() << "s OLSR routing table changed, " << size << " routes.");
+            // Only a change for one of our neighbors can change the election.
+            if (UpdateOlsrReachability()) {
+                ForwarderElection();
+            }
+        }
+        bool
+        RoutingProtocol::UpdateOlsrReachability() {
+            std::set<Ipv4Address> reachable;
+            if (m_olsr_onNode) {
+                Ipv4Header header;
+                Socket::SocketErrno error;
+                for (NeighborSet::const_iterator it = m_state.GetNeighbors().begin(); it != m_state.GetNeighbors().end(); it++) {
+                    header.SetDestination(it->first);
+                    if (m_olsr_onNode->RouteOutput(0, header, 0, error)) {
+                        reachable.insert(it->first);
+                    }
+                }
+            }
+            if (reachable == m_olsrReachable) {
+                return false;
+            }
+            m_olsrReachable.swap(reachable);
+            return true;
+        }
+        void RoutingProtocol::ForwarderElection() {
+            if (!m_running) {
+                return;
+            }
+            bool wasForwarding = forward;
             switch (m_willingness) {
                 case AIMF_WILL_ALWAYS:
                     forward = true;
                     break;
-                case 1:
-                    t++;
-                case 2:
-                    t++;
-                case AIMF_WILL_DEFAULT:
-                    t++;
-                case 4:
-                    t++;
-                case 5:
-                    t++;
-                case AIMF_WILL_HIGH:
-                    m_olsrCheck.Schedule(m_olsrCheckInterval + Time(Seconds(t)));
-                    for (std::vector<NeighborTuple>::iterator neig = m_state.GetNeighbors().begin(); neig != m_state.GetNeighbors().end(); neig++) {
-                        for (std::vector<olsr::RoutingTableEntry>::iterator route = v.begin(); route != v.end(); route++) {
-                            if (route->destAddr == neig->neighborMainAddr) {
-                                if (neig->willingness >= j) {
-                                    j = neig->willingness;
-                                }
-                            }
-                        }
-                    }
-                    if (j <= m_willingness) {
-                        forward = true; //ALERT PIM
-                    } else {
-                        forward = false; //ALERT PIM
-                    }
-                    break;
                 case AIMF_WILL_NEVER:
                     forward = false;
                     break;
+                default:
+                    forward = true;
+                    // No neighbor is as willing as we are, whether it is reachable or not.
+                    if (m_state.WillingnessMaxInSystem() < m_willingness) {
+                        break;
+                    }
+                    // Equal willingness is decided by the higher address, so that
+                    // exactly one gateway of a partition forwards.
+                    for (NeighborSet::const_iterator neig = m_state.GetNeighbors().begin(); neig != m_state.GetNeighbors().end(); neig++) {
+                        if (Outranks(neig->second.willingness, neig->first, m_willingness, m_mainAddress)
+                                && IsReachable(neig->first)) {
+                            forward = false; //ALERT PIM
+                            break;
+                        }
+                    }
+                    break;
+            }
+            if (forward != wasForwarding) {
+                NS_LOG_DEBUG(Simulator::Now().GetSeconds() << "s AIMF node " << m_mainAddress
+                        << (forward ? " starts" : " stops") << " forwarding.");
+            }
+            for (MulticastFib::iterator it = m_table.begin(); it != m_table.end(); it++) {
+                SetEntryForward(it->second, IsEntryForwarder(it->first));
+            }
+        }
+        bool
+        RoutingProtocol::Outranks(uint8_t will, const Ipv4Address &address,
+                uint8_t otherWill, const Ipv4Address &otherAddress) {
+            return will > otherWill || (will == otherWill && otherAddress < address);
+        }
+        bool
+        RoutingProtocol::IsReachable(const Ipv4Address &neighbor) const {
+            // Without OLSR on the node every AIMF neighbor counts as reachable.
+            return !m_olsr_onNode || m_olsrReachable.find(neighbor) != m_olsrReachable.end();
+        }
+        uint8_t
+        RoutingProtocol::GroupWillingness(const SourceGroup &key) const {
+            const Association *assoc = m_state.FindAssociation(key.group, key.groupPrefixLength, key.source);
+            if (assoc != NULL && assoc->will <= AIMF_WILL_ALWAYS) {
+                return assoc->will;
+            }
+            return m_willingness;
+        }
+        uint8_t
+        RoutingProtocol::GroupWillingness(const SourceGroup &key, const NeighborTuple &neighbor) const {
+            const AssociationTuple *tuple = m_state.FindAssociationTuple(neighbor.neighborMainAddr, key.group, key.groupPrefixLength, key.source);
+            if (tuple != NULL && tuple->will <= AIMF_WILL_ALWAYS) {
+                return tuple->will;
+            }
+            return neighbor.willingness;
+        }
+        uint32_t
+        RoutingProtocol::RendezvousWeight(const SourceGroup &key, const Ipv4Address &gateway) {
+            uint32_t h = static_cast<uint32_t> (SourceGroupHash()(key)) ^ gateway.Get();
+            // MurmurHash3 finalizer, so that each gateway gets an even share of the groups.
+            h ^= h >> 16;
+            h *= 0x85ebca6b;
+            h ^= h >> 13;
+            h *= 0xc2b2ae35;
+            h ^= h >> 16;
+            return h;
+        }
+        bool
+        RoutingProtocol::IsEntryForwarder(const SourceGroup &key) const {
+            if (!m_running) {
+                return false;
+            }
+            if (!m_loadSharing) {
+                return forward;
+            }
+            uint8_t bestWill = GroupWillingness(key);
+            if (bestWill == AIMF_WILL_ALWAYS) {
+                return true;
+            }
+            if (bestWill == AIMF_WILL_NEVER) {
+                return false;
+            }
+            // Rendezvous hashing among the most willing reachable gateways: every
+            // gateway ranks the candidates the same way, and a gateway coming or
+            // going only moves the groups it wins or loses.
+            Ipv4Address best = m_mainAddress;
+            uint32_t bestWeight = RendezvousWeight(key, m_mainAddress);
+            for (NeighborSet::const_iterator neig = m_state.GetNeighbors().begin(); neig != m_state.GetNeighbors().end(); neig++) {
+                uint8_t will = GroupWillingness(key, neig->second);
+                if (will < bestWill || !IsReachable(neig->first)) {
+                    continue;
+                }
+                uint32_t weight = RendezvousWeight(key, neig->first);
+                if (will > bestWill || weight > bestWeight
+                        || (weight == bestWeight && best < neig->first)) {
+                    bestWill = will;
+                    best = neig->first;
+                    bestWeight = weight;
+                }
             }
+            return best == m_mainAddress;
         }
     }
 }
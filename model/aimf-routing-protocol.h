@@ -14,7 +14,6 @@
 #include "ns3/packet.h"
 #include "ns3/node.h"
 #include "ns3/socket.h"
-#include "ns3/event-garbage-collector.h"
 #include "ns3/random-variable-stream.h"
 #include "ns3/timer.h"
 #include "ns3/traced-callback.h"
@@ -25,11 +24,13 @@
 #include "aimf-header.h"
 #include "aimf-state.h"
 #include "aimf-repository.h"
+#include "aimf-lpm-table.h"
 #include "ns3/olsr-routing-protocol.h"
 #include "ns3/ipv4-list-routing.h"
 
 #include <vector>
 #include <map>
+#include <tr1/unordered_set>
 
 
 namespace ns3 {
@@ -59,6 +60,18 @@ namespace ns3 {
             //             * Return the list of routing table entries discovered by AIMF
             //             **/
             std::vector<Ipv4MulticastRoutingTableEntry> GetRoutingTableEntries() const;
+            /// Received AIMF packets dropped because they did not parse.
+            uint32_t GetMalformedPackets() const;
+            /// Unicast routes AIMF installed on its interfaces.
+            uint32_t GetNUnicastRoutes() const;
+            /// True if one of those routes matches dest.
+            bool HasUnicastRoute(const Ipv4Address &dest) const;
+            /// The entry a packet from origin to group is forwarded by.
+            /// \return false if no entry matches
+            bool LookupRoutingTableEntry(const Ipv4Address &origin, const Ipv4Address &group,
+                    Ipv4MulticastRoutingTableEntry &entry) const;
+            /// Group prefix lengths below 32 that have entries, longest first.
+            const std::vector<uint8_t> & GetGroupPrefixLengths() const;
             //
             //            /*
             //             * Assign a fixed random variable stream number to the random variables
@@ -79,6 +92,30 @@ namespace ns3 {
             //             */
             typedef void (* TableChangeTracedCallback) (uint32_t size);
 
+            /**
+             * TracedCallback signature for incremental routing table changes.
+             *
+             * \param [in] added (S,G) entries installed since the last change.
+             * \param [in] removed (S,G) entries withdrawn since the last change.
+             */
+            typedef void (* TableDeltaTracedCallback) (const std::vector<SourceGroup> &added,
+                    const std::vector<SourceGroup> &removed);
+
+            /**
+             * TracedCallback signature for neighbor events.
+             *
+             * \param [in] neighbor Main address of the neighbor.
+             */
+            typedef void (* NeighborTracedCallback) (const Ipv4Address &neighbor);
+
+            /**
+             * TracedCallback signature for group activity changes.
+             *
+             * \param [in] key The (S,G) entry.
+             * \param [in] spotted True if packets started arriving, false if they stopped.
+             */
+            typedef void (* ActivityTracedCallback) (const SourceGroup &key, bool spotted);
+
             //
         private:
             std::set<uint32_t> m_interfaceExclusions;
@@ -99,20 +136,31 @@ namespace ns3 {
 
 
             void AddNeigbour(NeighborTuple tuple);
-            void RemoveNeighborset(Ipv4Address adress);
             void SetInterfaceExclusions(std::set<uint32_t> exceptions);
             void SetNetdevicelistener(std::set<uint32_t> listen);
 
-            void AddHostMulticastAssociation(Ipv4Address group, Ipv4Address source);
+            /// \return false if group is not a multicast group, the call is then
+            /// logged and ignored
+            bool AddHostMulticastAssociation(Ipv4Address group, Ipv4Address source);
             void
             RemoveHostMulticastAssociation(Ipv4Address group, Ipv4Address source);
+            /// Advertise a willingness of its own for a local association,
+            /// AIMF_WILL_INHERIT (255) makes it follow the node willingness again.
+            void SetGroupWillingness(Ipv4Address group, Ipv4Address source, uint8_t will);
+            /// The same for every group under groupMask, 225.1.0.0/16 for
+            /// instance, advertised and forwarded as one association.
+            bool AddHostMulticastPrefix(Ipv4Address group, Ipv4Mask groupMask, Ipv4Address source);
+            void RemoveHostMulticastPrefix(Ipv4Address group, Ipv4Mask groupMask, Ipv4Address source);
+            void SetGroupPrefixWillingness(Ipv4Address group, Ipv4Mask groupMask, Ipv4Address source, uint8_t will);
 
 
 
 
             void SleepForwarding(bool sleep);
             void ChangeWillingness(uint8_t will);
+            /// Stop AIMF on the node. Does nothing if it is not running.
             void DoStop();
+            /// Start AIMF again after DoStop. Does nothing if it is running.
             void DoStart();
 
 
@@ -120,29 +168,44 @@ namespace ns3 {
         protected:
             virtual void DoInitialize(void);
         private:
-            std::map<Ipv4Address, Ipv4MulticastRoutingTableEntry> m_table; ///< Data structure for the routing table.
+            MulticastFib m_table; ///< (S,G)/(*,G) multicast forwarding table.
+            /// Entries with the forward flag set. A node with none is on standby,
+            /// RouteInput then only counts the packets.
+            uint32_t m_forwardingEntries;
+            /// Set the forward flag of the entry through here, it keeps m_forwardingEntries.
+            void SetEntryForward(MulticastFibEntry &fib, bool forward);
 
             Ptr<olsr::RoutingProtocol> m_olsr_onNode;
 
-            EventGarbageCollector m_events;
-
             // Packets sequence number counter.
             uint16_t m_packetSequenceNumber;
             // Messages sequence number counter.
             uint16_t m_messageSequenceNumber;
-            // Advertised Neighbor Set sequence number.
+            // Received AIMF packets dropped as malformed.
+            uint32_t m_malformedPackets;
+            // Bytes of the packet RecvAimf is reading, kept between packets.
+            std::vector<uint8_t> m_rxBuffer;
+            // Advertised association set sequence number, incremented on every local association change.
             uint16_t m_ansn;
 
             // HELLO messages' emission interval.
             Time m_helloInterval;
-            Time m_olsrCheckInterval;
+            // Interval until the next HELLO, between m_helloInterval and m_maxHelloInterval.
+            Time m_currentHelloInterval;
+            Time m_maxHelloInterval;
+            bool m_adaptiveHello;
 
 
             // Internal state with all needed data structs.
             AimfState m_state;
             //
             Ptr<Ipv4> m_ipv4;
-            void ReceivingMulticast(Ipv4Address group);
+            /// Id of the node, for the log prefix.
+            uint32_t m_nodeId;
+            /// Turn the per entry packet counters into activity state and rates.
+            void SampleActivity(const Time &now);
+            Time m_activityTimeout;
+            Time m_lastActivitySample;
 
 
 
@@ -152,9 +215,33 @@ namespace ns3 {
             void Clear();
             //
 
-            void RemoveEntry(const Ipv4Address &dest); //ok
-            void AddEntry(const Ipv4Address &dgroup,
-                    const Ipv4Address &source,
+            void RemoveEntry(const SourceGroup &key);
+
+            /// Take a reference on the (S,G) entry, installing it on first use.
+            void AcquireEntry(const SourceGroup &key);
+            /// Drop a reference on the (S,G) entry, removing it when unused.
+            void ReleaseEntry(const SourceGroup &key);
+            /// Recompute the designated forwarder flag of the (S,G) entry, if any.
+            void ElectEntry(const SourceGroup &key);
+            /// Entries per group prefix length, and the lengths below
+            /// AIMF_SINGLE_GROUP_PREFIX that have entries, longest first.
+            /// FindEntry probes only those.
+            uint32_t m_groupPrefixEntries[AIMF_SINGLE_GROUP_PREFIX + 1];
+            std::vector<uint8_t> m_groupPrefixLengths;
+            /// Count an entry added to or erased from m_table.
+            void CountGroupPrefix(uint8_t length, bool added);
+            /// Turn group and groupMask into a group prefix and its length.
+            /// \return false, and logs, unless the mask is contiguous and
+            /// the prefix lies within 224.0.0.0/4
+            bool GetGroupPrefix(Ipv4Address &group, Ipv4Mask groupMask, uint8_t &length) const;
+            void RecordTableChange(const SourceGroup &key, bool added);
+            /// Fire the table traces if entries were added or removed since the last call.
+            void NotifyTableChange();
+
+            /// (S,G) entries added and removed since the last NotifyTableChange.
+            std::vector<SourceGroup> m_tableAdded;
+            std::vector<SourceGroup> m_tableRemoved;
+            void AddEntry(const SourceGroup &key,
                     uint32_t inputInterface,
                     std::vector<uint32_t> outputInterfaces);
 
@@ -165,15 +252,6 @@ namespace ns3 {
 
         private:
             
-            /// Container for the network routes
-            typedef std::list<std::pair <Ipv4RoutingTableEntry *, uint32_t> > NetworkRoutes;
-
-            /// Const Iterator for container for the network routes
-            typedef std::list<std::pair <Ipv4RoutingTableEntry *, uint32_t> >::const_iterator NetworkRoutesCI;
-
-            /// Iterator for container for the network routes
-            typedef std::list<std::pair <Ipv4RoutingTableEntry *, uint32_t> >::iterator NetworkRoutesI;
-
             /**
              * \brief Lookup in the forwarding table for destination.
              * \param dest destination address
@@ -182,14 +260,27 @@ namespace ns3 {
              */
             Ptr<Ipv4Route> LookupStatic(Ipv4Address dest, Ptr<NetDevice> oif = 0);
 
+            /**
+             * \brief Find the forwarding entry for a packet from origin to group.
+             *
+             * The source specific (S,G) entry is preferred, the (*,G) entry is
+             * used as fallback.
+             * \param origin source address
+             * \param group group multicast address
+             * \return the entry, or NULL if there is none
+             */
+            const MulticastFibEntry* FindEntry(const Ipv4Address &origin,
+                    const Ipv4Address &group) const;
+
             /**
              * \brief Lookup in the multicast forwarding table for destination.
              * \param origin source address
              * \param group group multicast address
              * \param interface interface index
-             * \return Ipv4MulticastRoute to route the packet to reach dest address
+             * \return the entry holding the Ipv4MulticastRoute and the designated
+             * forwarder flag, or NULL if there is no route from this interface
              */
-            Ptr<Ipv4MulticastRoute> LookupStatic(Ipv4Address origin, Ipv4Address group,
+            const MulticastFibEntry* LookupStatic(Ipv4Address origin, Ipv4Address group,
                     uint32_t interface, uint8_t will);
 
             /**
@@ -200,12 +291,14 @@ namespace ns3 {
              */
             Ipv4Address SourceAddressSelection(uint32_t interface, Ipv4Address dest);
 
-
-        public:
             /**
              * \brief the forwarding table for network.
              */
-            NetworkRoutes m_networkRoutes;
+            LpmTable m_networkRoutes;
+            /// Link-local multicast routes by device index, dropped on any address or interface change.
+            std::vector<Ptr<Ipv4Route> > m_linkLocalRoutes;
+
+        public:
 
 
 
@@ -228,7 +321,6 @@ namespace ns3 {
             virtual void NotifyRemoveAddress(uint32_t interface, Ipv4InterfaceAddress address);
             virtual void SetIpv4(Ptr<Ipv4> ipv4); //ok
             virtual void PrintRoutingTable(Ptr<OutputStreamWrapper> stream) const; //ok
-            void AssociationTupleTimerExpire(Ipv4Address advertiser, Ipv4Address group, Ipv4Address source);
 
 
 
@@ -246,9 +338,79 @@ namespace ns3 {
 
 
             Timer m_helloTimer;
-            Timer m_olsrCheck;
             void HelloTimerExpire();
-            void OlsrTimerExpire();
+
+            /// Expires neighbors, association tuples and group activity in one
+            /// batch, the only per node event besides the HELLOs.
+            Timer m_sweepTimer;
+            Time m_sweepInterval;
+            void SweepTimerExpire();
+            /// Go back to the fast HELLO interval after a change, in AdaptiveHello mode.
+            void ResetHelloInterval();
+            /// Random delay between 0 and m_maxJitter.
+            Time Jitter();
+            /// Send a HELLO after a jitter, unless one is already pending.
+            void TriggerHello();
+            Time m_maxJitter;
+            EventId m_triggeredHello;
+
+            /// Outgoing messages, serialized back to back, and their sizes.
+            /// SendQueuedMessages packs them into as few packets as the MTU allows.
+            std::vector<uint8_t> m_queuedMessages;
+            std::vector<uint16_t> m_queuedMessageSizes;
+            /// How long a message may wait for others to share its packet.
+            Time m_aggregationWindow;
+            Timer m_queuedMessagesTimer;
+            /// Send the queue now with a zero window, else start the window unless it runs.
+            void ScheduleQueuedMessages();
+            void SendQueuedMessages();
+            /// Largest AIMF packet that fits the MTU of every AIMF interface.
+            uint32_t GetMaxPacketSize() const;
+
+            /// Connected to the "RoutingTableChanged" trace of OLSR on this node,
+            /// which fires after every OLSR table computation, changed or not.
+            void OlsrRoutingTableChanged(uint32_t size);
+            /// Ask OLSR for a route to each AIMF neighbor.
+            /// \return true if the reachable neighbors changed
+            bool UpdateOlsrReachability();
+            /// Decide whether this node forwards. Runs on every change of its inputs:
+            /// own willingness, the AIMF neighbor set and OLSR reachability.
+            void ForwarderElection();
+
+            /// AIMF neighbors OLSR has a route to.
+            std::set<Ipv4Address> m_olsrReachable;
+            /// True between DoInitialize and DoStop.
+            bool m_running;
+            /// Elect a forwarder per (S,G) instead of one for all groups.
+            bool m_loadSharing;
+
+            /// Send the association set only when m_ansn changes or m_fullHelloInterval has passed.
+            bool m_deltaHello;
+            Time m_fullHelloInterval;
+            /// ANSN and time of the last HELLO that carried the association set.
+            uint16_t m_fullHelloAnsn;
+            Time m_lastFullHello;
+            /// A neighbor asked for the association set, or we just started.
+            bool m_resyncRequested;
+            /// Fragments of the current set neighbors asked for again, sent
+            /// by the next HELLO unless it carries the whole set.
+            std::set<uint8_t> m_requestedFragments;
+            /// The local association set serialized, rebuilt by SendHello after a change.
+            aimf::HelloTemplate m_helloTemplate;
+            /// Cleared with every m_ansn change.
+            bool m_helloTemplateValid;
+
+            bool IsReachable(const Ipv4Address &neighbor) const;
+            /// Total order of the gateways: willingness first, the higher address on a tie.
+            static bool Outranks(uint8_t will, const Ipv4Address &address,
+                    uint8_t otherWill, const Ipv4Address &otherAddress);
+            /// Willingness this node advertises for the (S,G).
+            uint8_t GroupWillingness(const SourceGroup &key) const;
+            /// Willingness the neighbor advertises for the (S,G).
+            uint8_t GroupWillingness(const SourceGroup &key, const NeighborTuple &neighbor) const;
+            static uint32_t RendezvousWeight(const SourceGroup &key, const Ipv4Address &gateway);
+            /// True if this node is the designated forwarder of the (S,G).
+            bool IsEntryForwarder(const SourceGroup &key) const;
             
 
 
@@ -256,7 +418,8 @@ namespace ns3 {
 
 
 
-            void SendMessage(const MessageHeader &message); //ok
+            /// Queue a message for the next packet, sent within m_aggregationWindow.
+            void QueueMessage(const MessageHeader &message); //ok
             void SendHello(); //ok
             void AddAssociationTuple(const AssociationTuple &tuple);
             void RemoveAssociationTuple(const AssociationTuple &tuple);
@@ -265,12 +428,25 @@ namespace ns3 {
 
 
 
-            void ProcessHello(const aimf::MessageHeader &msg,
+            void ProcessHello(const aimf::MessageView &msg,
+                    const aimf::HelloView &hello,
                     const Ipv4Address &receiverIface,
                     const Ipv4Address & senderIface); //ok
-
-            void PopulateNeighborSet(const aimf::MessageHeader &msg,
+            /// Ask the neighbor for its association set of ansn: the fragments
+            /// still missing if part of that set came, else the whole set.
+            void SendResync(const NeighborTuple &neighbor, uint16_t ansn);
+            void ProcessResync(const aimf::MessageHeader::Resync &resync);
+            /// Announce that this node stops (withdraw) or lowered its willingness.
+            void SendGoodbye(bool withdraw);
+            void ProcessGoodbye(const aimf::MessageView &msg,
+                    const aimf::MessageHeader::Goodbye &goodbye);
+
+            void PopulateNeighborSet(const aimf::MessageView &msg,
+                    const aimf::HelloView &hello,
                     const Time & now);
+            /// Take in a fragment of a full HELLO of the neighbor. It is synced
+            /// once every fragment of one ANSN came, in whatever order.
+            void ReceiveFragment(NeighborTuple &neighbor, const aimf::HelloView &hello);
 
             /// Check that address is one of my interfaces
             bool IsMyOwnAddress(const Ipv4Address & a) const;
@@ -285,7 +461,10 @@ namespace ns3 {
             TracedCallback<Ptr<const Packet>, Ptr<Ipv4>, uint32_t> m_txMcastPacketTrace;
             TracedCallback<Ptr<const Packet>, Ptr<Ipv4>, uint32_t> m_txHelloPacketTrace;
 
+            TracedCallback <const Ipv4Address &> m_neighborLost;
+            TracedCallback <const SourceGroup &, bool> m_groupActivity;
             TracedCallback <uint32_t> m_routingTableChanged;
+            TracedCallback <const std::vector<SourceGroup> &, const std::vector<SourceGroup> &> m_routingTableDelta;
 
             /// Provides uniform random variables.
 
@@ -18,72 +18,42 @@ namespace ns3 {
 
         void
         AimfState::InsertAssociationTuple(const AssociationTuple &tuple) {
-            m_associationSet.push_back(tuple);
-        }
-
-        Time* AimfState::FindTimer(Ipv4Address const &mainAddr) {
-            for (TimerMap::iterator it = m_timerMap.begin(); it != m_timerMap.end(); it++) {
-                if (it->first == mainAddr) {
-                    return &(it->second);
-                }
-            }
-            return NULL;
-        }
-
-        void AimfState::ClearTimer() {
-            m_timerMap.clear();
-        }
-
-        void AimfState::AddTimer(Ipv4Address const &mainAddr, Time &time) {
-            m_timerMap.insert(std::make_pair<Ipv4Address, Time>(mainAddr, time));
-        }
-
-        void AimfState::EraseTimer(Ipv4Address const &mainAddr) {
-            m_timerMap.erase(mainAddr);
+            AssociationKey key = {tuple.advertiser, tuple.group, tuple.groupPrefixLength, tuple.source};
+            m_associationSet[key] = tuple;
         }
 
         /********** Neighbor Set Manipulation **********/
 
         NeighborTuple*
         AimfState::FindNeighborTuple(Ipv4Address const &mainAddr) {
-            for (NeighborSet::iterator it = m_neighborSet.begin();
-                    it != m_neighborSet.end(); it++) {
-                if (it->neighborMainAddr == mainAddr)
-                    return &(*it);
+            NeighborSet::iterator it = m_neighborSet.find(mainAddr);
+            if (it == m_neighborSet.end()) {
+                return NULL;
             }
-            return NULL;
+            return &(it->second);
         }
 
         const NeighborTuple*
         AimfState::FindSymNeighborTuple(Ipv4Address const &mainAddr) const {
-            for (NeighborSet::const_iterator it = m_neighborSet.begin();
-                    it != m_neighborSet.end(); it++) {
-                if (it->neighborMainAddr == mainAddr)
-                    return &(*it);
+            NeighborSet::const_iterator it = m_neighborSet.find(mainAddr);
+            if (it == m_neighborSet.end()) {
+                return NULL;
             }
-            return NULL;
+            return &(it->second);
         }
 
         NeighborTuple*
         AimfState::FindNeighborTuple(Ipv4Address const &mainAddr, uint8_t willingness) {
-            for (NeighborSet::iterator it = m_neighborSet.begin();
-                    it != m_neighborSet.end(); it++) {
-                if (it->neighborMainAddr == mainAddr && it->willingness == willingness)
-                    return &(*it);
+            NeighborTuple *tuple = FindNeighborTuple(mainAddr);
+            if (tuple != NULL && tuple->willingness == willingness) {
+                return tuple;
             }
             return NULL;
         }
 
         int
         AimfState::WillingnessOk(uint8_t const will) {
-            uint8_t k = 0;
-
-            for (NeighborSet::const_iterator it = m_neighborSet.begin();
-                    it != m_neighborSet.end(); it++) {
-
-                if (it->willingness >= k)
-                    k = it->willingness;
-            }
+            uint8_t k = (uint8_t) WillingnessMaxInSystem();
             if (will == k) {
                 return 1;
             }
@@ -92,109 +62,110 @@ namespace ns3 {
 
         int
         AimfState::WillingnessMaxInSystem() {
-            uint8_t k = 0;
-
-            for (NeighborSet::iterator it = m_neighborSet.begin();
-                    it != m_neighborSet.end(); it++) {
-
-                if (it->willingness > k)
-                    k = it->willingness;
+            for (int level = AIMF_WILL_LEVELS - 1; level > 0; level--) {
+                if (m_willingnessCount[level] > 0)
+                    return level;
             }
-            return k;
+            return 0;
         }
 
         uint8_t AimfState::WillingnessNextMaxInSystem() {
-            uint8_t max, secmax;
-            if (m_neighborSet.size() < 2) {
-                return ((uint8_t) WillingnessMaxInSystem());
-            }
-
-            if (m_neighborSet.at(0).willingness > m_neighborSet.at(1).willingness) {
-                max = m_neighborSet.at(0).willingness;
-                secmax = m_neighborSet.at(1).willingness;
-            } else {
-                secmax = m_neighborSet.at(0).willingness;
-                max = m_neighborSet.at(1).willingness;
+            uint8_t max = (uint8_t) WillingnessMaxInSystem();
+            if (m_neighborSet.size() < 2 || m_willingnessCount[max] > 1) {
+                return max;
             }
-            if (m_neighborSet.size() < 3) {
-                return (secmax);
-            }
-
-            int i = 0;
-            for (NeighborSet::iterator it = m_neighborSet.begin();
-                    it != m_neighborSet.end(); it++) {
-
-                if (i < 2) {
-                    i++;
-                    continue;
-                }
-                if (it->willingness > max) {
-                    secmax = max;
-                    max = it->willingness;
-                } else if (it->willingness > secmax && it->willingness != max)
-                    secmax = it->willingness;
+            for (int level = max - 1; level > 0; level--) {
+                if (m_willingnessCount[level] > 0)
+                    return level;
             }
-            return secmax;
+            return 0;
         }
 
         void
         AimfState::EraseNeighborTuple(const NeighborTuple &tuple) {
-            for (NeighborSet::iterator it = m_neighborSet.begin();
-                    it != m_neighborSet.end(); it++) {
-                if (*it == tuple) {
-                    m_neighborSet.erase(it);
-                    break;
-                }
+            NeighborSet::iterator it = m_neighborSet.find(tuple.neighborMainAddr);
+            if (it != m_neighborSet.end() && it->second == tuple) {
+                m_willingnessCount[WillingnessLevel(it->second.willingness)]--;
+                m_neighborSet.erase(it);
             }
         }
 
         void
         AimfState::EraseNeighborTuple(const Ipv4Address &mainAddr) {
-            for (NeighborSet::iterator it = m_neighborSet.begin();
-                    it != m_neighborSet.end(); it++) {
-                if (it->neighborMainAddr == mainAddr) {
-                    it = m_neighborSet.erase(it);
-                    break;
-                }
+            NeighborSet::iterator it = m_neighborSet.find(mainAddr);
+            if (it != m_neighborSet.end()) {
+                m_willingnessCount[WillingnessLevel(it->second.willingness)]--;
+                m_neighborSet.erase(it);
             }
         }
 
         void
         AimfState::InsertNeighborTuple(NeighborTuple const &tuple) {
-            for (NeighborSet::iterator it = m_neighborSet.begin();
-                    it != m_neighborSet.end(); it++) {
-                if (it->neighborMainAddr == tuple.neighborMainAddr) {
-                    // Update it
-                    *it = tuple;
-                    return;
-                }
+            NeighborSet::iterator it = m_neighborSet.find(tuple.neighborMainAddr);
+            if (it != m_neighborSet.end()) {
+                // Update it
+                m_willingnessCount[WillingnessLevel(it->second.willingness)]--;
+                it->second = tuple;
+            } else {
+                m_neighborSet[tuple.neighborMainAddr] = tuple;
             }
-            m_neighborSet.push_back(tuple);
+            m_willingnessCount[WillingnessLevel(tuple.willingness)]++;
+        }
+
+        void
+        AimfState::SetNeighborWillingness(NeighborTuple &tuple, uint8_t willingness) {
+            m_willingnessCount[WillingnessLevel(tuple.willingness)]--;
+            m_willingnessCount[WillingnessLevel(willingness)]++;
+            tuple.willingness = willingness;
         }
 
         /********** Host-Multicast Association Set Manipulation **********/
 
 
         AssociationTuple*
-        AimfState::FindAssociationTuple(const Ipv4Address &advertiser, const Ipv4Address &group, const Ipv4Address &source) {
-            for (AssociationSet::iterator it = m_associationSet.begin();
-                    it != m_associationSet.end(); it++) {
-                if (it->advertiser == advertiser and it->group == group and it->source == source) {
+        AimfState::FindAssociationTuple(const Ipv4Address &advertiser, const Ipv4Address &group, uint8_t groupPrefixLength, const Ipv4Address &source) {
+            AssociationKey key = {advertiser, group, groupPrefixLength, source};
+            AssociationSet::iterator it = m_associationSet.find(key);
+            if (it == m_associationSet.end()) {
+                return NULL;
+            }
+            return &(it->second);
+        }
+
+        const AssociationTuple*
+        AimfState::FindAssociationTuple(const Ipv4Address &advertiser, const Ipv4Address &group, uint8_t groupPrefixLength, const Ipv4Address &source) const {
+            AssociationKey key = {advertiser, group, groupPrefixLength, source};
+            AssociationSet::const_iterator it = m_associationSet.find(key);
+            if (it == m_associationSet.end()) {
+                return NULL;
+            }
+            return &(it->second);
+        }
+
+        Association*
+        AimfState::FindAssociation(const Ipv4Address &group, uint8_t groupPrefixLength, const Ipv4Address &source) {
+            for (Associations::iterator it = m_associations.begin(); it != m_associations.end(); it++) {
+                if (it->group == group && it->groupPrefixLength == groupPrefixLength && it->source == source) {
                     return &(*it);
                 }
             }
             return NULL;
         }
 
-        void
-        AimfState::EraseAssociationTuple(const AssociationTuple &tuple) {
-            for (AssociationSet::iterator it = m_associationSet.begin();
-                    it != m_associationSet.end(); it++) {
-                if (*it == tuple) {
-                    m_associationSet.erase(it);
-                    break;
+        const Association*
+        AimfState::FindAssociation(const Ipv4Address &group, uint8_t groupPrefixLength, const Ipv4Address &source) const {
+            for (Associations::const_iterator it = m_associations.begin(); it != m_associations.end(); it++) {
+                if (it->group == group && it->groupPrefixLength == groupPrefixLength && it->source == source) {
+                    return &(*it);
                 }
             }
+            return NULL;
+        }
+
+        void
+        AimfState::EraseAssociationTuple(const AssociationTuple &tuple) {
+            AssociationKey key = {tuple.advertiser, tuple.group, tuple.groupPrefixLength, tuple.source};
+            m_associationSet.erase(key);
         }
 
         void
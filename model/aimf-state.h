@@ -10,6 +10,9 @@
 
 #include "aimf-repository.h"
 
+/// Number of willingness levels, 0 (never) to 7 (always).
+#define AIMF_WILL_LEVELS 8
+
 namespace ns3 {
     namespace aimf {
 
@@ -19,15 +22,23 @@ namespace ns3 {
         protected:
 
             NeighborSet m_neighborSet; 
-            TimerMap m_timerMap;  
             IfaceAssocSet m_ifaceAssocSet; 
             AssociationSet m_associationSet; 
             Associations m_associations; 
             UniqnessTable m_unikTable;
+            /// Number of neighbors per willingness level, kept up to date with m_neighborSet.
+            /// Levels above AIMF_WILL_LEVELS - 1 are counted in the top level.
+            uint32_t m_willingnessCount[AIMF_WILL_LEVELS];
+
+            static uint8_t WillingnessLevel(uint8_t willingness) {
+                return willingness < AIMF_WILL_LEVELS ? willingness : AIMF_WILL_LEVELS - 1;
+            }
         public:
 
             AimfState(){
-                
+                for (uint8_t i = 0; i < AIMF_WILL_LEVELS; i++) {
+                    m_willingnessCount[i] = 0;
+                }
             };
             
             //Partition handling
@@ -39,6 +50,7 @@ namespace ns3 {
                 return m_neighborSet;
             }
 
+            // Change willingness through SetNeighborWillingness, or the willingness index goes stale.
             NeighborSet & GetNeighbors() {
                 return m_neighborSet;
             }
@@ -49,12 +61,9 @@ namespace ns3 {
             
             
             uint8_t FindUnik(uint8_t t);
-            Time* FindTimer(Ipv4Address const &mainAddr);
-            void AddTimer(Ipv4Address const &mainAddr, Time &time);
-            void EraseTimer(Ipv4Address const &mainAddr);
-            void ClearTimer();
                 
             
+            // Lookups are hashed. The returned pointers stay valid until the tuple is erased.
             NeighborTuple* FindNeighborTuple(const Ipv4Address &mainAddr);
             const NeighborTuple* FindSymNeighborTuple(const Ipv4Address &mainAddr) const;
             NeighborTuple* FindNeighborTuple(const Ipv4Address &mainAddr,
@@ -62,6 +71,8 @@ namespace ns3 {
             void EraseNeighborTuple(const NeighborTuple &neighborTuple);
             void EraseNeighborTuple(const Ipv4Address &mainAddr);
             void InsertNeighborTuple(const NeighborTuple &tuple);
+            void SetNeighborWillingness(NeighborTuple &tuple, uint8_t willingness);
+            // Read from the willingness index, independent of the number of neighbors.
             int WillingnessOk(uint8_t const will);
             int
             WillingnessMaxInSystem();
@@ -77,6 +88,11 @@ namespace ns3 {
                 return m_associationSet;
             }
 
+            AssociationSet & GetAssociationSet()
+            {
+                return m_associationSet;
+            }
+
             const Associations & GetAssociations() const // Set of associations that the node has
             {
                 return m_associations;
@@ -84,9 +100,17 @@ namespace ns3 {
 
 
 
+            // A group range is found by its first address and prefix length, not by a group inside it.
             AssociationTuple* FindAssociationTuple(const Ipv4Address &advertiser, \
                                           const Ipv4Address &group, \
+                                          uint8_t groupPrefixLength, \
                                           const Ipv4Address &source);
+            const AssociationTuple* FindAssociationTuple(const Ipv4Address &advertiser,
+                                          const Ipv4Address &group,
+                                          uint8_t groupPrefixLength,
+                                          const Ipv4Address &source) const;
+            Association* FindAssociation(const Ipv4Address &group, uint8_t groupPrefixLength, const Ipv4Address &source);
+            const Association* FindAssociation(const Ipv4Address &group, uint8_t groupPrefixLength, const Ipv4Address &source) const;
             void EraseAssociationTuple(const AssociationTuple &tuple);
             void InsertAssociationTuple(const AssociationTuple &tuple);
             void EraseAssociation(const Association &tuple);
@@ -2,10 +2,32 @@
 
 // Include a header file from your module to test.
 #include "ns3/aimf-header.h"
+#include "ns3/aimf-helper.h"
+#include "ns3/aimf-lpm-table.h"
+#include "ns3/aimf-routing-protocol.h"
 
 // An essential include is test.h
 #include "ns3/test.h"
 
+#include "ns3/simulator.h"
+#include "ns3/log.h"
+#include "ns3/boolean.h"
+#include "ns3/nstime.h"
+#include "ns3/simple-net-device-helper.h"
+#include "ns3/simple-net-device.h"
+#include "ns3/error-model.h"
+#include "ns3/internet-stack-helper.h"
+#include "ns3/ipv4-address-helper.h"
+#include "ns3/ipv4-list-routing-helper.h"
+#include "ns3/ipv4-static-routing-helper.h"
+#include "ns3/ipv4-list-routing.h"
+#include "ns3/udp-socket-factory.h"
+#include "ns3/inet-socket-address.h"
+
+#include <algorithm>
+#include <set>
+#include <sstream>
+
 // Do not put your test classes in namespace ns3.  You may find it useful
 // to use the using directive to access the ns3 namespace directly
 using namespace ns3;
@@ -46,6 +68,1567 @@ AimfTestCase1::DoRun (void)
   NS_TEST_ASSERT_MSG_EQ_TOL (0.01, 0.01, 0.001, "Numbers are not equal within tolerance");
 }
 
+static Ptr<aimf::RoutingProtocol>
+GetAimf (Ptr<Node> node)
+{
+  Ptr<Ipv4ListRouting> list = DynamicCast<Ipv4ListRouting> (node->GetObject<Ipv4> ()->GetRoutingProtocol ());
+  for (uint32_t i = 0; i < list->GetNRoutingProtocols (); i++)
+    {
+      int16_t priority;
+      Ptr<aimf::RoutingProtocol> aimf = DynamicCast<aimf::RoutingProtocol> (list->GetRoutingProtocol (i, priority));
+      if (aimf)
+        {
+          return aimf;
+        }
+    }
+  return 0;
+}
+
+static void
+CountMcTx (uint32_t *count, Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t interface)
+{
+  (*count)++;
+}
+
+// A source and gateways on a LAN that runs AIMF. The gateways are also on
+// a MANET that AIMF does not run on. Returns the LAN addresses, the
+// source first.
+//
+//   source   gw0   gw1 ...
+//     |       |     |
+//   ====================  LAN (AIMF)
+//             |     |
+//   ====================  MANET
+static Ipv4InterfaceContainer
+BuildLan (NodeContainer source, NodeContainer gateways, AimfHelper &aimf, NetDeviceContainer &lan)
+{
+  SimpleNetDeviceHelper simple;
+  lan = simple.Install (NodeContainer (source, gateways));
+  NetDeviceContainer manet = simple.Install (gateways);
+
+  for (uint32_t i = 0; i < gateways.GetN (); i++)
+    {
+      aimf.ExcludeInterface (gateways.Get (i), 2);
+      aimf.SetMANETNetDeviceID (gateways.Get (i), 2);
+    }
+  Ipv4StaticRoutingHelper staticRouting;
+  Ipv4ListRoutingHelper list;
+  list.Add (staticRouting, 0);
+  list.Add (aimf, 10);
+
+  InternetStackHelper internet;
+  internet.Install (source);
+  InternetStackHelper gatewayInternet;
+  gatewayInternet.SetRoutingHelper (list);
+  gatewayInternet.Install (gateways);
+
+  Ipv4AddressHelper ipv4;
+  ipv4.SetBase ("10.1.1.0", "255.255.255.0");
+  Ipv4InterfaceContainer lanAddresses = ipv4.Assign (lan);
+  ipv4.SetBase ("10.1.2.0", "255.255.255.0");
+  ipv4.Assign (manet);
+  return lanAddresses;
+}
+
+// Gateways of equal willingness on one LAN must elect exactly one forwarder
+// onto the MANET, with and without per-group load sharing.
+//
+//   source   gw0   gw1 ... gwN-1
+//     |       |     |        |
+//   ============================  LAN (AIMF)
+//             |     |        |
+//   ============================  MANET
+class AimfSingleForwarderTestCase : public TestCase
+{
+public:
+  AimfSingleForwarderTestCase (uint32_t gateways, bool loadSharing);
+  virtual ~AimfSingleForwarderTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void SendData (void);
+
+  uint32_t m_gateways;
+  bool m_loadSharing;
+  Ptr<Socket> m_socket;
+  Ipv4Address m_group;
+  std::vector<uint32_t> m_mcTx;
+};
+
+AimfSingleForwarderTestCase::AimfSingleForwarderTestCase (uint32_t gateways, bool loadSharing)
+  : TestCase ("Equal willingness gateways elect a single forwarder"),
+    m_gateways (gateways),
+    m_loadSharing (loadSharing),
+    m_group ("225.1.2.4")
+{
+}
+
+AimfSingleForwarderTestCase::~AimfSingleForwarderTestCase ()
+{
+}
+
+void
+AimfSingleForwarderTestCase::SendData (void)
+{
+  m_socket->SendTo (Create<Packet> (100), 0, InetSocketAddress (m_group, 9));
+}
+
+void
+AimfSingleForwarderTestCase::DoRun (void)
+{
+  NodeContainer source;
+  source.Create (1);
+  NodeContainer gateways;
+  gateways.Create (m_gateways);
+  AimfHelper aimf;
+  aimf.Set ("LoadSharing", BooleanValue (m_loadSharing));
+  NetDeviceContainer lan;
+  Ipv4InterfaceContainer lanAddresses = BuildLan (source, gateways, aimf, lan);
+  Ipv4StaticRoutingHelper staticRouting;
+  staticRouting.SetDefaultMulticastRoute (source.Get (0), lan.Get (0));
+
+  m_mcTx.assign (m_gateways, 0);
+  for (uint32_t i = 0; i < m_gateways; i++)
+    {
+      Ptr<aimf::RoutingProtocol> gateway = GetAimf (gateways.Get (i));
+      gateway->TraceConnectWithoutContext ("McTx", MakeBoundCallback (&CountMcTx, &m_mcTx[i]));
+      Simulator::Schedule (Seconds (1), &aimf::RoutingProtocol::AddHostMulticastAssociation,
+                           gateway, m_group, lanAddresses.GetAddress (0));
+    }
+
+  m_socket = Socket::CreateSocket (source.Get (0), UdpSocketFactory::GetTypeId ());
+  m_socket->Bind ();
+  const uint32_t packets = 20;
+  for (uint32_t i = 0; i < packets; i++)
+    {
+      Simulator::Schedule (Seconds (10) + MilliSeconds (100 * i),
+                           &AimfSingleForwarderTestCase::SendData, this);
+    }
+  Simulator::Stop (Seconds (15));
+  Simulator::Run ();
+
+  uint32_t forwarders = 0;
+  uint32_t forwarded = 0;
+  for (uint32_t i = 0; i < m_gateways; i++)
+    {
+      forwarders += (m_mcTx[i] > 0) ? 1 : 0;
+      forwarded += m_mcTx[i];
+    }
+  NS_TEST_ASSERT_MSG_EQ (forwarders, 1, "Expected a single McTx source");
+  NS_TEST_ASSERT_MSG_EQ (forwarded, packets, "Every packet must be forwarded exactly once");
+
+  m_socket = 0;
+  Simulator::Destroy ();
+}
+
+// With load sharing, which is on by default, the groups are spread over
+// the gateways of equal willingness: each packet is still forwarded once,
+// by more than one gateway over all the groups.
+class AimfLoadSharingTestCase : public TestCase
+{
+public:
+  AimfLoadSharingTestCase ();
+  virtual ~AimfLoadSharingTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void SendData (Ipv4Address group);
+
+  Ptr<Socket> m_socket;
+};
+
+AimfLoadSharingTestCase::AimfLoadSharingTestCase ()
+  : TestCase ("Load sharing spreads the groups over the gateways")
+{
+}
+
+AimfLoadSharingTestCase::~AimfLoadSharingTestCase ()
+{
+}
+
+void
+AimfLoadSharingTestCase::SendData (Ipv4Address group)
+{
+  m_socket->SendTo (Create<Packet> (100), 0, InetSocketAddress (group, 9));
+}
+
+void
+AimfLoadSharingTestCase::DoRun (void)
+{
+  const uint32_t gatewayCount = 3;
+  const uint32_t groupCount = 8;
+  const uint32_t packets = 5;
+  NodeContainer source;
+  source.Create (1);
+  NodeContainer gateways;
+  gateways.Create (gatewayCount);
+  AimfHelper aimf;
+  NetDeviceContainer lan;
+  Ipv4InterfaceContainer lanAddresses = BuildLan (source, gateways, aimf, lan);
+  Ipv4StaticRoutingHelper staticRouting;
+  staticRouting.SetDefaultMulticastRoute (source.Get (0), lan.Get (0));
+
+  std::vector<uint32_t> mcTx (gatewayCount, 0);
+  for (uint32_t i = 0; i < gatewayCount; i++)
+    {
+      Ptr<aimf::RoutingProtocol> gateway = GetAimf (gateways.Get (i));
+      gateway->TraceConnectWithoutContext ("McTx", MakeBoundCallback (&CountMcTx, &mcTx[i]));
+      for (uint32_t g = 0; g < groupCount; g++)
+        {
+          Simulator::Schedule (Seconds (1), &aimf::RoutingProtocol::AddHostMulticastAssociation,
+                               gateway, Ipv4Address (0xe1010200 + g), lanAddresses.GetAddress (0));
+        }
+    }
+
+  m_socket = Socket::CreateSocket (source.Get (0), UdpSocketFactory::GetTypeId ());
+  m_socket->Bind ();
+  for (uint32_t i = 0; i < packets; i++)
+    {
+      for (uint32_t g = 0; g < groupCount; g++)
+        {
+          Simulator::Schedule (Seconds (10) + MilliSeconds (100 * i + g),
+                               &AimfLoadSharingTestCase::SendData, this, Ipv4Address (0xe1010200 + g));
+        }
+    }
+  Simulator::Stop (Seconds (15));
+  Simulator::Run ();
+
+  uint32_t forwarders = 0;
+  uint32_t forwarded = 0;
+  for (uint32_t i = 0; i < gatewayCount; i++)
+    {
+      forwarders += (mcTx[i] > 0) ? 1 : 0;
+      forwarded += mcTx[i];
+    }
+  NS_TEST_ASSERT_MSG_GT (forwarders, 1, "A single gateway forwarded every group");
+  NS_TEST_ASSERT_MSG_EQ (forwarded, groupCount * packets, "Every packet must be forwarded exactly once");
+
+  m_socket = 0;
+  Simulator::Destroy ();
+}
+
+// Every gateway must learn the associations of the others from their
+// HELLOs and end up with the same routing table. This held only in builds
+// with logging enabled. The build profile is fixed for the whole binary, so
+// the scenario runs with every AIMF log statement enabled and with none,
+// which is what the optimized profile runs, and the tables are compared
+// with each other and with the one both profiles must produce.
+//
+//   source   gw0   gw1   gw2
+//     |       |     |     |
+//   ========================  LAN (AIMF)
+//             |     |     |
+//   ========================  MANET
+class AimfLearnedRoutesTestCase : public TestCase
+{
+public:
+  AimfLearnedRoutesTestCase ();
+  virtual ~AimfLearnedRoutesTestCase ();
+
+private:
+  typedef std::set<std::pair<uint32_t, uint32_t> > RouteSet;
+
+  virtual void DoRun (void);
+  // The (origin, group) entries of each gateway at the end of the scenario.
+  std::vector<RouteSet> RunScenario (bool logging);
+};
+
+AimfLearnedRoutesTestCase::AimfLearnedRoutesTestCase ()
+  : TestCase ("Gateways learn each other's associations and agree on the routing table")
+{
+}
+
+AimfLearnedRoutesTestCase::~AimfLearnedRoutesTestCase ()
+{
+}
+
+std::vector<AimfLearnedRoutesTestCase::RouteSet>
+AimfLearnedRoutesTestCase::RunScenario (bool logging)
+{
+  const uint32_t gatewayCount = 3;
+  NodeContainer source;
+  source.Create (1);
+  NodeContainer gateways;
+  gateways.Create (gatewayCount);
+  AimfHelper aimf;
+  NetDeviceContainer lan;
+  Ipv4InterfaceContainer lanAddresses = BuildLan (source, gateways, aimf, lan);
+
+  // Each gateway joins a group of its own, and one of them the (*,G) of a shared group.
+  for (uint32_t i = 0; i < gatewayCount; i++)
+    {
+      Simulator::Schedule (Seconds (1), &aimf::RoutingProtocol::AddHostMulticastAssociation,
+                           GetAimf (gateways.Get (i)), Ipv4Address (0xe1010200 + i), lanAddresses.GetAddress (0));
+    }
+  Simulator::Schedule (Seconds (1), &aimf::RoutingProtocol::AddHostMulticastAssociation,
+                       GetAimf (gateways.Get (0)), Ipv4Address ("225.1.3.1"), Ipv4Address::GetAny ());
+
+  // The log output is of no interest, only the code that produces it.
+  std::ostringstream log;
+  std::streambuf *clog = std::clog.rdbuf ();
+  if (logging)
+    {
+      std::clog.rdbuf (log.rdbuf ());
+      LogComponentEnable ("AimfRoutingProtocol", LOG_LEVEL_ALL);
+      LogComponentEnable ("AimfHeader", LOG_LEVEL_ALL);
+    }
+  Simulator::Stop (Seconds (10));
+  Simulator::Run ();
+  if (logging)
+    {
+      LogComponentDisable ("AimfRoutingProtocol", LOG_LEVEL_ALL);
+      LogComponentDisable ("AimfHeader", LOG_LEVEL_ALL);
+      std::clog.rdbuf (clog);
+    }
+
+  std::vector<RouteSet> tables (gatewayCount);
+  for (uint32_t i = 0; i < gatewayCount; i++)
+    {
+      std::vector<Ipv4MulticastRoutingTableEntry> entries = GetAimf (gateways.Get (i))->GetRoutingTableEntries ();
+      for (std::vector<Ipv4MulticastRoutingTableEntry>::const_iterator it = entries.begin (); it != entries.end (); it++)
+        {
+          tables[i].insert (std::make_pair (it->GetOrigin ().Get (), it->GetGroup ().Get ()));
+        }
+    }
+  Simulator::Destroy ();
+  return tables;
+}
+
+void
+AimfLearnedRoutesTestCase::DoRun (void)
+{
+  RouteSet expected;
+  uint32_t source = Ipv4Address ("10.1.1.1").Get ();
+  for (uint32_t i = 0; i < 3; i++)
+    {
+      expected.insert (std::make_pair (source, 0xe1010200 + i));
+    }
+  expected.insert (std::make_pair (Ipv4Address::GetAny ().Get (), Ipv4Address ("225.1.3.1").Get ()));
+
+  std::vector<RouteSet> quiet = RunScenario (false);
+  std::vector<RouteSet> logged = RunScenario (true);
+  for (uint32_t i = 0; i < quiet.size (); i++)
+    {
+      NS_TEST_ASSERT_MSG_EQ ((quiet[i] == expected), true, "gw" << i << " did not learn every association");
+      NS_TEST_ASSERT_MSG_EQ ((logged[i] == quiet[i]), true, "gw" << i << " learns other routes with logging on");
+    }
+}
+
+struct HelloSizes
+{
+  uint32_t largest;
+  // Largest once the association set is known to the neighbor.
+  uint32_t largestSettled;
+};
+
+static void
+TrackHelloSize (HelloSizes *sizes, Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t interface)
+{
+  sizes->largest = std::max (sizes->largest, packet->GetSize ());
+  if (Simulator::Now () >= Seconds (6))
+    {
+      sizes->largestSettled = std::max (sizes->largestSettled, packet->GetSize ());
+    }
+}
+
+// A gateway with 5000 associations must split its HELLO into packets that
+// fit the MTU, and its neighbor must reassemble the set: with DeltaHello a
+// neighbor that missed a fragment keeps asking for the full set again.
+class AimfLargeAssociationSetTestCase : public TestCase
+{
+public:
+  AimfLargeAssociationSetTestCase ();
+  virtual ~AimfLargeAssociationSetTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+AimfLargeAssociationSetTestCase::AimfLargeAssociationSetTestCase ()
+  : TestCase ("A set of 5000 associations is split to the MTU and reassembled")
+{
+}
+
+AimfLargeAssociationSetTestCase::~AimfLargeAssociationSetTestCase ()
+{
+}
+
+void
+AimfLargeAssociationSetTestCase::DoRun (void)
+{
+  const uint32_t associationCount = 5000;
+  const uint32_t mtu = 1500;
+  NodeContainer source;
+  source.Create (1);
+  NodeContainer gateways;
+  gateways.Create (2);
+  AimfHelper aimf;
+  aimf.Set ("DeltaHello", BooleanValue (true));
+  NetDeviceContainer lan;
+  Ipv4InterfaceContainer lanAddresses = BuildLan (source, gateways, aimf, lan);
+  for (uint32_t i = 0; i < lan.GetN (); i++)
+    {
+      lan.Get (i)->SetMtu (mtu);
+    }
+
+  Ptr<aimf::RoutingProtocol> gw0 = GetAimf (gateways.Get (0));
+  for (uint32_t i = 0; i < associationCount; i++)
+    {
+      Simulator::Schedule (Seconds (1), &aimf::RoutingProtocol::AddHostMulticastAssociation,
+                           gw0, Ipv4Address (0xe1000000 + i), lanAddresses.GetAddress (0));
+    }
+  HelloSizes sizes = {0, 0};
+  gw0->TraceConnectWithoutContext ("Tx", MakeBoundCallback (&TrackHelloSize, &sizes));
+  Simulator::Stop (Seconds (10));
+  Simulator::Run ();
+
+  // An AIMF packet plus the IPv4 and UDP headers.
+  NS_TEST_ASSERT_MSG_LT (sizes.largest + 28, mtu + 1, "A HELLO needs IP fragmentation");
+  NS_TEST_ASSERT_MSG_GT (sizes.largest, mtu / 2, "The association set was split more than needed");
+  NS_TEST_ASSERT_MSG_EQ (GetAimf (gateways.Get (1))->GetRoutingTableEntries ().size (), associationCount,
+                         "gw1 did not learn every association");
+  NS_TEST_ASSERT_MSG_LT (sizes.largestSettled, 100, "gw0 still sends its full set, gw1 did not reassemble it");
+
+  Simulator::Destroy ();
+}
+
+// Append the bytes of a full HELLO of originator with one association.
+static void
+AppendHello (std::vector<uint8_t> &bytes, Ipv4Address originator, Ipv4Address group, Ipv4Address source)
+{
+  aimf::MessageHeader msg;
+  msg.SetVTime (Seconds (60));
+  msg.SetOriginatorAddress (originator);
+  msg.SetTimeToLive (255);
+  msg.SetMessageSequenceNumber (1);
+  aimf::MessageHeader::Hello &hello = msg.GetHello ();
+  hello.SetHTime (Seconds (20));
+  hello.willingness = 3;
+  hello.ansn = 1;
+  hello.flags = aimf::MessageHeader::Hello::FULL;
+  hello.fragment = 0;
+  hello.fragments = 1;
+  aimf::MessageHeader::Hello::Association association = {group, 32, source, 3};
+  hello.associations.push_back (association);
+  Ptr<Packet> packet = Create<Packet> ();
+  packet->AddHeader (msg);
+  uint32_t offset = bytes.size ();
+  bytes.resize (offset + packet->GetSize ());
+  packet->CopyData (&bytes[offset], packet->GetSize ());
+}
+
+// An AIMF packet of the given messages, its length field set to length
+// bytes, or to its size if length is 0.
+static Ptr<Packet>
+MakeAimfPacket (const std::vector<uint8_t> &messages, uint16_t length = 0)
+{
+  std::vector<uint8_t> bytes (4);
+  bytes.insert (bytes.end (), messages.begin (), messages.end ());
+  if (length == 0)
+    {
+      length = bytes.size ();
+    }
+  bytes[0] = length >> 8;
+  bytes[1] = length & 0xff;
+  return Create<Packet> (&bytes[0], bytes.size ());
+}
+
+// A gateway must drop a malformed AIMF packet and count it, after it
+// processed the well formed messages in front of the bad one.
+class AimfMalformedPacketTestCase : public TestCase
+{
+public:
+  AimfMalformedPacketTestCase ();
+  virtual ~AimfMalformedPacketTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void Send (Ptr<Packet> packet);
+
+  Ptr<Socket> m_socket;
+  Ipv4Address m_gateway;
+};
+
+AimfMalformedPacketTestCase::AimfMalformedPacketTestCase ()
+  : TestCase ("Malformed AIMF packets are counted and dropped after their good messages")
+{
+}
+
+AimfMalformedPacketTestCase::~AimfMalformedPacketTestCase ()
+{
+}
+
+void
+AimfMalformedPacketTestCase::Send (Ptr<Packet> packet)
+{
+  m_socket->SendTo (packet, 0, InetSocketAddress (m_gateway, 1337));
+}
+
+void
+AimfMalformedPacketTestCase::DoRun (void)
+{
+  NodeContainer source;
+  source.Create (1);
+  NodeContainer gateways;
+  gateways.Create (1);
+  AimfHelper aimf;
+  NetDeviceContainer lan;
+  Ipv4InterfaceContainer lanAddresses = BuildLan (source, gateways, aimf, lan);
+  m_gateway = lanAddresses.GetAddress (1);
+  Ptr<aimf::RoutingProtocol> gw = GetAimf (gateways.Get (0));
+
+  // The source stands in for other gateways, AIMF only takes packets from its own port.
+  m_socket = Socket::CreateSocket (source.Get (0), UdpSocketFactory::GetTypeId ());
+  m_socket->Bind (InetSocketAddress (Ipv4Address::GetAny (), 1337));
+
+  Ipv4Address sender = lanAddresses.GetAddress (0);
+  std::vector<uint8_t> messages;
+
+  // Well formed, not counted.
+  AppendHello (messages, Ipv4Address ("10.1.1.100"), Ipv4Address ("225.2.0.0"), sender);
+  Simulator::Schedule (Seconds (2), &AimfMalformedPacketTestCase::Send, this, MakeAimfPacket (messages));
+
+  // A HELLO, then a message whose size is smaller than a message header.
+  uint8_t tooSmall[] = {1, 0x86, 0, 4, 10, 1, 1, 101, 255, 0, 1};
+  messages.clear ();
+  AppendHello (messages, Ipv4Address ("10.1.1.101"), Ipv4Address ("225.2.0.1"), sender);
+  messages.insert (messages.end (), tooSmall, tooSmall + sizeof (tooSmall));
+  Simulator::Schedule (Seconds (3), &AimfMalformedPacketTestCase::Send, this, MakeAimfPacket (messages));
+
+  // A HELLO, then a message larger than what is left of the packet.
+  uint8_t tooLarge[] = {1, 0x86, 0, 200, 10, 1, 1, 102, 255, 0, 1};
+  messages.clear ();
+  AppendHello (messages, Ipv4Address ("10.1.1.102"), Ipv4Address ("225.2.0.2"), sender);
+  messages.insert (messages.end (), tooLarge, tooLarge + sizeof (tooLarge));
+  Simulator::Schedule (Seconds (4), &AimfMalformedPacketTestCase::Send, this, MakeAimfPacket (messages));
+
+  // A HELLO, then a HELLO whose records do not divide into associations.
+  messages.clear ();
+  AppendHello (messages, Ipv4Address ("10.1.1.103"), Ipv4Address ("225.2.0.3"), sender);
+  uint32_t offset = messages.size ();
+  AppendHello (messages, Ipv4Address ("10.1.1.104"), Ipv4Address ("225.2.0.4"), sender);
+  messages.resize (messages.size () + 3);
+  uint16_t size = messages.size () - offset;
+  messages[offset + 2] = size >> 8;
+  messages[offset + 3] = size & 0xff;
+  Simulator::Schedule (Seconds (5), &AimfMalformedPacketTestCase::Send, this, MakeAimfPacket (messages));
+
+  // A packet length beyond the end of the datagram.
+  messages.clear ();
+  AppendHello (messages, Ipv4Address ("10.1.1.105"), Ipv4Address ("225.2.0.5"), sender);
+  Simulator::Schedule (Seconds (6), &AimfMalformedPacketTestCase::Send, this,
+                       MakeAimfPacket (messages, messages.size () + 5));
+
+  Simulator::Stop (Seconds (8));
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_EQ (gw->GetMalformedPackets (), 4, "Every malformed packet must be counted once");
+  std::set<uint32_t> groups;
+  std::vector<Ipv4MulticastRoutingTableEntry> entries = gw->GetRoutingTableEntries ();
+  for (std::vector<Ipv4MulticastRoutingTableEntry>::const_iterator it = entries.begin (); it != entries.end (); it++)
+    {
+      groups.insert (it->GetGroup ().Get ());
+    }
+  for (uint32_t i = 0; i <= 3; i++)
+    {
+      NS_TEST_ASSERT_MSG_EQ (groups.count (Ipv4Address ("225.2.0.0").Get () + i), 1,
+                             "The HELLO in front of bad message " << i << " was not processed");
+    }
+  NS_TEST_ASSERT_MSG_EQ (groups.count (Ipv4Address ("225.2.0.4").Get ()), 0, "A malformed HELLO was processed");
+  NS_TEST_ASSERT_MSG_EQ (groups.count (Ipv4Address ("225.2.0.5").Get ()), 0, "A packet with a bad length was processed");
+
+  m_socket = 0;
+  Simulator::Destroy ();
+}
+
+// The bytes of a serialized MessageHeader.
+static std::vector<uint8_t>
+SerializeMessage (const aimf::MessageHeader &msg)
+{
+  Ptr<Packet> packet = Create<Packet> ();
+  packet->AddHeader (msg);
+  std::vector<uint8_t> bytes (packet->GetSize ());
+  packet->CopyData (&bytes[0], bytes.size ());
+  return bytes;
+}
+
+// A HELLO written from a HelloTemplate must have the bytes of the same
+// HELLO serialized by MessageHeader, full, delta and fragmented.
+class AimfHelloTemplateTestCase : public TestCase
+{
+public:
+  AimfHelloTemplateTestCase ();
+  virtual ~AimfHelloTemplateTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+AimfHelloTemplateTestCase::AimfHelloTemplateTestCase ()
+  : TestCase ("HelloTemplate writes the bytes MessageHeader::Serialize writes")
+{
+}
+
+AimfHelloTemplateTestCase::~AimfHelloTemplateTestCase ()
+{
+}
+
+void
+AimfHelloTemplateTestCase::DoRun (void)
+{
+  std::vector<aimf::MessageHeader::Hello::Association> associations;
+  for (uint32_t i = 0; i < 20; i++)
+    {
+      aimf::MessageHeader::Hello::Association association = {Ipv4Address (0xe1000000 + i), 32,
+                                                             Ipv4Address (0x0a010100 + i), (uint8_t) (i % 8)};
+      // Some ranges among them, their records are a byte longer.
+      if (i % 5 == 0)
+        {
+          association.group = Ipv4Address (0xe1000000 + (i << 16));
+          association.groupPrefixLength = 16;
+        }
+      associations.push_back (association);
+    }
+  aimf::HelloTemplate helloTemplate;
+  for (uint32_t i = 0; i < associations.size (); i++)
+    {
+      helloTemplate.AddAssociation (associations[i]);
+    }
+
+  aimf::MessageHeader msg;
+  msg.SetVTime (Seconds (6));
+  msg.SetOriginatorAddress (Ipv4Address ("10.1.1.2"));
+  msg.SetTimeToLive (255);
+  msg.SetMessageSequenceNumber (4711);
+  aimf::MessageHeader::Hello &hello = msg.GetHello ();
+  hello.SetHTime (Seconds (2));
+  hello.willingness = 6;
+  hello.ansn = 513;
+  hello.fragment = 0;
+  hello.fragments = 1;
+
+  // Delta: no records either way.
+  hello.flags = 0;
+  std::vector<uint8_t> written;
+  uint32_t size = helloTemplate.AppendMessage (msg, 1500, written);
+  NS_TEST_ASSERT_MSG_EQ (size, written.size (), "AppendMessage returned the wrong size");
+  NS_TEST_ASSERT_MSG_EQ ((written == SerializeMessage (msg)), true, "Delta HELLOs differ");
+
+  // Full, in one message.
+  hello.flags = aimf::MessageHeader::Hello::FULL;
+  NS_TEST_ASSERT_MSG_EQ (helloTemplate.GetNFragments (1500), 1, "20 associations need one fragment");
+  written.clear ();
+  helloTemplate.AppendMessage (msg, 1500, written);
+  aimf::MessageHeader full = msg;
+  full.GetHello ().associations = associations;
+  NS_TEST_ASSERT_MSG_EQ ((written == SerializeMessage (full)), true, "Full HELLOs differ");
+
+  // Full, in fragments of at most 100 bytes, appended one after the other.
+  uint8_t fragments = helloTemplate.GetNFragments (100);
+  NS_TEST_ASSERT_MSG_GT (fragments, 1, "20 associations fit 100 bytes");
+  hello.fragments = fragments;
+  written.clear ();
+  std::vector<uint8_t> serialized;
+  uint32_t next = 0;
+  for (uint8_t fragment = 0; fragment < fragments; fragment++)
+    {
+      hello.fragment = fragment;
+      size = helloTemplate.AppendMessage (msg, 100, written);
+      NS_TEST_ASSERT_MSG_LT (size, 101, "Fragment " << (int) fragment << " is larger than asked");
+      full = msg;
+      aimf::MessageHeader::Hello &part = full.GetHello ();
+      while (next < associations.size ()
+             && SerializeMessage (full).size () < size)
+        {
+          part.associations.push_back (associations[next++]);
+        }
+      std::vector<uint8_t> bytes = SerializeMessage (full);
+      serialized.insert (serialized.end (), bytes.begin (), bytes.end ());
+    }
+  NS_TEST_ASSERT_MSG_EQ (next, associations.size (), "The fragments lost associations");
+  NS_TEST_ASSERT_MSG_EQ ((written == serialized), true, "Fragmented HELLOs differ");
+}
+
+// A HELLO with a record for one group and one for a range, and the bytes
+// of its packet.
+static std::vector<uint8_t>
+MakeRangeHello (void)
+{
+  aimf::MessageHeader msg;
+  msg.SetVTime (Seconds (6));
+  msg.SetOriginatorAddress (Ipv4Address ("10.1.1.2"));
+  msg.SetTimeToLive (255);
+  msg.SetMessageSequenceNumber (1);
+  aimf::MessageHeader::Hello &hello = msg.GetHello ();
+  hello.SetHTime (Seconds (2));
+  hello.willingness = 3;
+  hello.ansn = 1;
+  hello.flags = aimf::MessageHeader::Hello::FULL;
+  hello.fragment = 0;
+  hello.fragments = 1;
+  aimf::MessageHeader::Hello::Association single = {Ipv4Address ("225.1.2.3"), 32, Ipv4Address ("10.1.1.1"), 6};
+  aimf::MessageHeader::Hello::Association range = {Ipv4Address ("225.1.0.0"), 16, Ipv4Address ("10.1.1.9"), 5};
+  hello.associations.push_back (single);
+  hello.associations.push_back (range);
+  std::vector<uint8_t> bytes (4);
+  std::vector<uint8_t> message = SerializeMessage (msg);
+  bytes.insert (bytes.end (), message.begin (), message.end ());
+  bytes[1] = bytes.size ();
+  return bytes;
+}
+
+// Whether PacketReader takes the HELLO in the packet bytes.
+static bool
+ReadsHello (const std::vector<uint8_t> &bytes)
+{
+  aimf::PacketReader reader (&bytes[0], bytes.size ());
+  aimf::MessageView message;
+  aimf::HelloView hello;
+  return reader.Next (message) && aimf::PacketReader::ReadHello (message, hello);
+}
+
+// A record for a range of groups carries its prefix length, a record for
+// one group does not. ReadHello rejects prefix lengths above 32 and
+// groups with bits past their prefix, as AddHostMulticastAssociation and
+// AddHostMulticastPrefix reject groups outside 224.0.0.0/4.
+class AimfGroupPrefixRecordTestCase : public TestCase
+{
+public:
+  AimfGroupPrefixRecordTestCase ();
+  virtual ~AimfGroupPrefixRecordTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+AimfGroupPrefixRecordTestCase::AimfGroupPrefixRecordTestCase ()
+  : TestCase ("Group prefix records round trip and bad ones are rejected")
+{
+}
+
+AimfGroupPrefixRecordTestCase::~AimfGroupPrefixRecordTestCase ()
+{
+}
+
+void
+AimfGroupPrefixRecordTestCase::DoRun (void)
+{
+  std::vector<uint8_t> bytes = MakeRangeHello ();
+  // Packet and message headers, HELLO header, 9 and 10 byte records.
+  NS_TEST_ASSERT_MSG_EQ (bytes.size (), 4 + 11 + 8 + 9 + 10, "A record has the wrong size");
+
+  aimf::PacketReader reader (&bytes[0], bytes.size ());
+  aimf::MessageView message;
+  aimf::HelloView hello;
+  NS_TEST_ASSERT_MSG_EQ (reader.Next (message), true, "The HELLO was not read");
+  NS_TEST_ASSERT_MSG_EQ (aimf::PacketReader::ReadHello (message, hello), true, "The HELLO was rejected");
+  NS_TEST_ASSERT_MSG_EQ (hello.nAssociations, 2, "Records were lost");
+  uint32_t offset = 0;
+  aimf::MessageHeader::Hello::Association single = hello.ReadAssociation (offset);
+  NS_TEST_ASSERT_MSG_EQ (single.group, Ipv4Address ("225.1.2.3"), "Wrong group");
+  NS_TEST_ASSERT_MSG_EQ ((int) single.groupPrefixLength, 32, "A single group became a range");
+  NS_TEST_ASSERT_MSG_EQ (single.source, Ipv4Address ("10.1.1.1"), "Wrong source");
+  NS_TEST_ASSERT_MSG_EQ ((int) single.willGroupSSM, 6, "Wrong will");
+  aimf::MessageHeader::Hello::Association range = hello.ReadAssociation (offset);
+  NS_TEST_ASSERT_MSG_EQ (range.group, Ipv4Address ("225.1.0.0"), "Wrong range");
+  NS_TEST_ASSERT_MSG_EQ ((int) range.groupPrefixLength, 16, "Wrong prefix length");
+  NS_TEST_ASSERT_MSG_EQ (range.source, Ipv4Address ("10.1.1.9"), "Wrong source");
+  NS_TEST_ASSERT_MSG_EQ ((int) range.willGroupSSM, 5, "Wrong will");
+  NS_TEST_ASSERT_MSG_EQ (offset, 19, "The records were not read to their end");
+
+  // And through MessageHeader::Deserialize.
+  Ptr<Packet> packet = Create<Packet> (&bytes[4], bytes.size () - 4);
+  aimf::MessageHeader msg;
+  packet->RemoveHeader (msg);
+  const std::vector<aimf::MessageHeader::Hello::Association> &associations = msg.GetHello ().associations;
+  NS_TEST_ASSERT_MSG_EQ (associations.size (), 2, "Deserialize lost records");
+  NS_TEST_ASSERT_MSG_EQ ((int) associations[0].groupPrefixLength, 32, "Deserialize made a range");
+  NS_TEST_ASSERT_MSG_EQ (associations[1].group, Ipv4Address ("225.1.0.0"), "Deserialize read the wrong range");
+  NS_TEST_ASSERT_MSG_EQ ((int) associations[1].groupPrefixLength, 16, "Deserialize read the wrong length");
+  NS_TEST_ASSERT_MSG_EQ ((int) associations[1].willGroupSSM, 5, "Deserialize read the wrong will");
+
+  // The range record starts after the 9 byte single group record.
+  const uint32_t range_record = 4 + 11 + 8 + 9;
+  std::vector<uint8_t> bad = bytes;
+  bad[range_record + 9] = 33;
+  NS_TEST_ASSERT_MSG_EQ (ReadsHello (bad), false, "A prefix length above 32 was taken");
+  bad = bytes;
+  bad[range_record + 2] = 2;
+  NS_TEST_ASSERT_MSG_EQ (ReadsHello (bad), false, "A group with bits past its prefix was taken");
+  // The prefix length of the range cut off.
+  bad = bytes;
+  bad.pop_back ();
+  bad[1] = bad.size ();
+  bad[4 + 3] = bad.size () - 4;
+  NS_TEST_ASSERT_MSG_EQ (ReadsHello (bad), false, "A truncated range record was taken");
+  packet = Create<Packet> (&bad[4], bad.size () - 4);
+  NS_TEST_ASSERT_MSG_EQ (packet->RemoveHeader (msg), 0, "Deserialize took a truncated range record");
+  NS_TEST_ASSERT_MSG_EQ (packet->GetSize (), bad.size () - 4, "Deserialize consumed a malformed message");
+  // A message size past the end of the packet.
+  bad = bytes;
+  bad[4 + 3] += 1;
+  packet = Create<Packet> (&bad[4], bad.size () - 4);
+  NS_TEST_ASSERT_MSG_EQ (packet->RemoveHeader (msg), 0, "Deserialize read past the packet");
+
+  Ptr<aimf::RoutingProtocol> gw = CreateObject<aimf::RoutingProtocol> ();
+  NS_TEST_ASSERT_MSG_EQ (gw->AddHostMulticastAssociation (Ipv4Address ("10.0.0.1"), Ipv4Address ("10.1.1.1")), false,
+                         "A unicast group was taken");
+  NS_TEST_ASSERT_MSG_EQ (gw->AddHostMulticastPrefix (Ipv4Address ("192.0.0.0"), Ipv4Mask ("240.0.0.0"),
+                                                     Ipv4Address ("10.1.1.1")), false,
+                         "A range outside 224.0.0.0/4 was taken");
+  NS_TEST_ASSERT_MSG_EQ (gw->AddHostMulticastPrefix (Ipv4Address ("225.1.0.0"), Ipv4Mask ("255.0.255.0"),
+                                                     Ipv4Address ("10.1.1.1")), false,
+                         "A non contiguous mask was taken");
+  NS_TEST_ASSERT_MSG_EQ (gw->GetRoutingTableEntries ().size (), 0, "A rejected association installed an entry");
+}
+
+// Lookups take the (S,G) entry, then the (*,G) one, then the ranges
+// longest prefix first. The prefix lengths FindEntry walks follow the
+// ranges through adds, removes, RoutingTableComputation and DoStop.
+class AimfGroupPrefixLookupTestCase : public TestCase
+{
+public:
+  AimfGroupPrefixLookupTestCase ();
+  virtual ~AimfGroupPrefixLookupTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void Check (void);
+  void CheckStopped (void);
+  // The group of the entry a packet from origin to group is forwarded by,
+  // 0.0.0.0 if there is none.
+  Ipv4Address Lookup (const char *origin, const char *group) const;
+  std::vector<uint8_t> Lengths (void) const;
+
+  Ptr<aimf::RoutingProtocol> m_gw;
+};
+
+AimfGroupPrefixLookupTestCase::AimfGroupPrefixLookupTestCase ()
+  : TestCase ("Group prefix lookups and the prefix lengths they walk")
+{
+}
+
+AimfGroupPrefixLookupTestCase::~AimfGroupPrefixLookupTestCase ()
+{
+}
+
+Ipv4Address
+AimfGroupPrefixLookupTestCase::Lookup (const char *origin, const char *group) const
+{
+  Ipv4MulticastRoutingTableEntry entry;
+  if (!m_gw->LookupRoutingTableEntry (Ipv4Address (origin), Ipv4Address (group), entry))
+    {
+      return Ipv4Address::GetAny ();
+    }
+  return entry.GetGroup ();
+}
+
+std::vector<uint8_t>
+AimfGroupPrefixLookupTestCase::Lengths (void) const
+{
+  return m_gw->GetGroupPrefixLengths ();
+}
+
+void
+AimfGroupPrefixLookupTestCase::Check (void)
+{
+  Ipv4MulticastRoutingTableEntry entry;
+  NS_TEST_ASSERT_MSG_EQ (m_gw->LookupRoutingTableEntry (Ipv4Address ("10.1.1.1"), Ipv4Address ("225.1.2.3"), entry),
+                         true, "No entry for (S,G)");
+  NS_TEST_ASSERT_MSG_EQ (entry.GetOrigin (), Ipv4Address ("10.1.1.1"), "(*,G) was taken over (S,G)");
+  NS_TEST_ASSERT_MSG_EQ (m_gw->LookupRoutingTableEntry (Ipv4Address ("10.1.1.7"), Ipv4Address ("225.1.2.3"), entry),
+                         true, "No entry for (*,G)");
+  NS_TEST_ASSERT_MSG_EQ (entry.GetOrigin (), Ipv4Address::GetAny (), "(*,G) was not taken for another source");
+  NS_TEST_ASSERT_MSG_EQ (entry.GetGroup (), Ipv4Address ("225.1.2.3"), "A range was taken over (*,G)");
+  // The /24 for any source is longer than the /16 of the source.
+  NS_TEST_ASSERT_MSG_EQ (Lookup ("10.1.1.1", "225.1.2.9"), Ipv4Address ("225.1.2.0"), "The longest prefix was not taken");
+  NS_TEST_ASSERT_MSG_EQ (Lookup ("10.1.1.1", "225.1.3.1"), Ipv4Address ("225.1.0.0"), "The /16 was not taken");
+  NS_TEST_ASSERT_MSG_EQ (Lookup ("10.1.1.7", "225.1.3.1"), Ipv4Address::GetAny (), "The /16 is for one source only");
+  // Bits past the prefix are cleared.
+  NS_TEST_ASSERT_MSG_EQ (Lookup ("10.1.1.1", "225.4.9.9"), Ipv4Address ("225.4.0.0"), "225.4.5.6/16 is 225.4.0.0/16");
+
+  std::vector<uint8_t> lengths = Lengths ();
+  NS_TEST_ASSERT_MSG_EQ (lengths.size (), 2, "Wrong prefix lengths");
+  NS_TEST_ASSERT_MSG_EQ ((int) lengths[0], 24, "The longest prefix must come first");
+  NS_TEST_ASSERT_MSG_EQ ((int) lengths[1], 16, "Wrong prefix lengths");
+  // Non-contiguous masks, prefixes shorter than /4 and ranges outside
+  // 224.0.0.0/4 were ignored.
+  NS_TEST_ASSERT_MSG_EQ (m_gw->GetRoutingTableEntries ().size (), 5, "A bad prefix was installed");
+
+  m_gw->RemoveHostMulticastPrefix (Ipv4Address ("225.1.2.0"), Ipv4Mask ("255.255.255.0"), Ipv4Address::GetAny ());
+  lengths = Lengths ();
+  NS_TEST_ASSERT_MSG_EQ (lengths.size (), 1, "The /24 is still walked");
+  NS_TEST_ASSERT_MSG_EQ (Lookup ("10.1.1.1", "225.1.2.9"), Ipv4Address ("225.1.0.0"), "The /16 was not taken");
+
+  m_gw->RoutingTableComputation ();
+  lengths = Lengths ();
+  NS_TEST_ASSERT_MSG_EQ (lengths.size (), 1, "RoutingTableComputation miscounted the prefixes");
+  NS_TEST_ASSERT_MSG_EQ ((int) lengths[0], 16, "RoutingTableComputation miscounted the prefixes");
+  NS_TEST_ASSERT_MSG_EQ (m_gw->GetRoutingTableEntries ().size (), 4, "RoutingTableComputation changed the table");
+
+  m_gw->DoStop ();
+}
+
+void
+AimfGroupPrefixLookupTestCase::CheckStopped (void)
+{
+  NS_TEST_ASSERT_MSG_EQ (m_gw->GetRoutingTableEntries ().size (), 0, "DoStop left entries");
+  NS_TEST_ASSERT_MSG_EQ (Lengths ().size (), 0, "DoStop left prefix lengths");
+  NS_TEST_ASSERT_MSG_EQ (Lookup ("10.1.1.1", "225.1.3.1"), Ipv4Address::GetAny (), "A lookup found a cleared range");
+}
+
+void
+AimfGroupPrefixLookupTestCase::DoRun (void)
+{
+  NodeContainer source;
+  source.Create (1);
+  NodeContainer gateways;
+  gateways.Create (1);
+  AimfHelper aimf;
+  NetDeviceContainer lan;
+  BuildLan (source, gateways, aimf, lan);
+  m_gw = GetAimf (gateways.Get (0));
+
+  Ipv4Address s ("10.1.1.1");
+  Ipv4Address any = Ipv4Address::GetAny ();
+  Simulator::Schedule (Seconds (1), &aimf::RoutingProtocol::AddHostMulticastAssociation,
+                       m_gw, Ipv4Address ("225.1.2.3"), s);
+  Simulator::Schedule (Seconds (1), &aimf::RoutingProtocol::AddHostMulticastAssociation,
+                       m_gw, Ipv4Address ("225.1.2.3"), any);
+  Simulator::Schedule (Seconds (1), &aimf::RoutingProtocol::AddHostMulticastPrefix,
+                       m_gw, Ipv4Address ("225.1.2.0"), Ipv4Mask ("255.255.255.0"), any);
+  Simulator::Schedule (Seconds (1), &aimf::RoutingProtocol::AddHostMulticastPrefix,
+                       m_gw, Ipv4Address ("225.1.0.0"), Ipv4Mask ("255.255.0.0"), s);
+  Simulator::Schedule (Seconds (1), &aimf::RoutingProtocol::AddHostMulticastPrefix,
+                       m_gw, Ipv4Address ("225.4.5.6"), Ipv4Mask ("255.255.0.0"), s);
+  Simulator::Schedule (Seconds (1), &aimf::RoutingProtocol::AddHostMulticastPrefix,
+                       m_gw, Ipv4Address ("225.5.0.0"), Ipv4Mask ("255.0.255.0"), s);
+  Simulator::Schedule (Seconds (1), &aimf::RoutingProtocol::AddHostMulticastPrefix,
+                       m_gw, Ipv4Address ("224.0.0.0"), Ipv4Mask ("224.0.0.0"), s);
+  Simulator::Schedule (Seconds (1), &aimf::RoutingProtocol::AddHostMulticastPrefix,
+                       m_gw, Ipv4Address ("10.0.0.0"), Ipv4Mask ("255.0.0.0"), s);
+  Simulator::Schedule (Seconds (2), &AimfGroupPrefixLookupTestCase::Check, this);
+  Simulator::Schedule (Seconds (3), &AimfGroupPrefixLookupTestCase::CheckStopped, this);
+  Simulator::Stop (Seconds (4));
+  Simulator::Run ();
+
+  m_gw = 0;
+  Simulator::Destroy ();
+}
+
+// The AIMF packets a gateway sent or received, and the messages in them.
+struct AimfPacketLog
+{
+  std::vector<Time> times;
+  std::vector<uint32_t> sizes;
+  // Messages of each type, by packet.
+  std::vector<std::vector<uint32_t> > messages;
+};
+
+static void
+LogAimfPacket (AimfPacketLog *log, Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t interface)
+{
+  std::vector<uint8_t> bytes (packet->GetSize ());
+  packet->CopyData (&bytes[0], bytes.size ());
+  std::vector<uint32_t> messages (aimf::MessageHeader::GOODBYE_MESSAGE + 1, 0);
+  aimf::PacketReader reader (&bytes[0], bytes.size ());
+  aimf::MessageView message;
+  while (reader.Next (message))
+    {
+      messages[std::min<uint32_t> (message.messageType, aimf::MessageHeader::GOODBYE_MESSAGE)]++;
+    }
+  log->times.push_back (Simulator::Now ());
+  log->sizes.push_back (packet->GetSize ());
+  log->messages.push_back (messages);
+}
+
+// Outgoing messages are queued for AggregationWindow and packed into as
+// few packets as the MTU allows. With a window of 0 every message goes out
+// on its own.
+class AimfMessageQueueTestCase : public TestCase
+{
+public:
+  AimfMessageQueueTestCase (Time window);
+  virtual ~AimfMessageQueueTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void SendBurst (uint32_t resyncs);
+
+  Time m_window;
+  Ptr<aimf::RoutingProtocol> m_gw;
+};
+
+AimfMessageQueueTestCase::AimfMessageQueueTestCase (Time window)
+  : TestCase ("Queued messages share MTU sized packets within the aggregation window"),
+    m_window (window)
+{
+}
+
+AimfMessageQueueTestCase::~AimfMessageQueueTestCase ()
+{
+}
+
+void
+AimfMessageQueueTestCase::SendBurst (uint32_t resyncs)
+{
+  m_gw->SendHello ();
+  for (uint32_t i = 0; i < resyncs; i++)
+    {
+      aimf::NeighborTuple neighbor = {Ipv4Address (0x0a010164 + i), Seconds (0), 3};
+      m_gw->SendResync (neighbor, 0);
+    }
+}
+
+void
+AimfMessageQueueTestCase::DoRun (void)
+{
+  const uint32_t mtu = 576;
+  NodeContainer source;
+  source.Create (1);
+  NodeContainer gateways;
+  gateways.Create (1);
+  AimfHelper aimf;
+  aimf.Set ("AggregationWindow", TimeValue (m_window));
+  NetDeviceContainer lan;
+  Ipv4InterfaceContainer lanAddresses = BuildLan (source, gateways, aimf, lan);
+  for (uint32_t i = 0; i < lan.GetN (); i++)
+    {
+      lan.Get (i)->SetMtu (mtu);
+    }
+  m_gw = GetAimf (gateways.Get (0));
+  AimfPacketLog sent;
+  m_gw->TraceConnectWithoutContext ("Tx", MakeBoundCallback (&LogAimfPacket, &sent));
+
+  // A HELLO and a RESYNC at once, then a burst larger than a packet.
+  Simulator::Schedule (Seconds (2), &AimfMessageQueueTestCase::SendBurst, this, 1);
+  for (uint32_t i = 0; i < 100; i++)
+    {
+      Simulator::Schedule (Seconds (3), &aimf::RoutingProtocol::AddHostMulticastAssociation,
+                           m_gw, Ipv4Address (0xe1000000 + i), lanAddresses.GetAddress (0));
+    }
+  Simulator::Schedule (Seconds (4), &AimfMessageQueueTestCase::SendBurst, this, 100);
+  Simulator::Stop (Seconds (5));
+  Simulator::Run ();
+
+  uint32_t maxSize = m_gw->GetMaxPacketSize ();
+  NS_TEST_ASSERT_MSG_EQ (maxSize, mtu - 28, "The largest packet must fit the MTU with IP and UDP headers");
+  std::vector<uint32_t> pair;
+  uint32_t burstPackets = 0;
+  uint32_t burstResyncs = 0;
+  for (uint32_t n = 0; n < sent.times.size (); n++)
+    {
+      NS_TEST_ASSERT_MSG_LT (sent.sizes[n], maxSize + 1, "A packet is larger than GetMaxPacketSize ()");
+      if (sent.times[n] >= Seconds (2) && sent.times[n] <= Seconds (2) + m_window)
+        {
+          pair.push_back (n);
+        }
+      if (sent.times[n] >= Seconds (4) && sent.times[n] <= Seconds (4) + m_window)
+        {
+          burstPackets++;
+          burstResyncs += sent.messages[n][aimf::MessageHeader::RESYNC_MESSAGE];
+        }
+    }
+  if (m_window.IsZero ())
+    {
+      NS_TEST_ASSERT_MSG_EQ (pair.size (), 2, "Without a window the HELLO and the RESYNC need a packet each");
+      for (uint32_t n = 0; n < pair.size (); n++)
+        {
+          const std::vector<uint32_t> &messages = sent.messages[pair[n]];
+          NS_TEST_ASSERT_MSG_EQ (messages[aimf::MessageHeader::HELLO_MESSAGE]
+                                 + messages[aimf::MessageHeader::RESYNC_MESSAGE], 1,
+                                 "A packet carries more than one message");
+        }
+      NS_TEST_ASSERT_MSG_GT (burstPackets, 100, "Without a window every message needs a packet");
+    }
+  else
+    {
+      NS_TEST_ASSERT_MSG_EQ (pair.size (), 1, "The HELLO and the RESYNC must share a packet");
+      // A periodic HELLO may join them.
+      NS_TEST_ASSERT_MSG_GT (sent.messages[pair[0]][aimf::MessageHeader::HELLO_MESSAGE], 0, "The HELLO is missing");
+      NS_TEST_ASSERT_MSG_EQ (sent.messages[pair[0]][aimf::MessageHeader::RESYNC_MESSAGE], 1, "The RESYNC is missing");
+      // 100 RESYNCs and the HELLO fragments need a few packets, not one per message.
+      NS_TEST_ASSERT_MSG_GT (burstPackets, 1, "The burst cannot fit one packet");
+      NS_TEST_ASSERT_MSG_LT (burstPackets, 10, "The burst was not packed");
+    }
+  NS_TEST_ASSERT_MSG_EQ (burstResyncs, 100, "RESYNCs of the burst were lost");
+
+  m_gw = 0;
+  Simulator::Destroy ();
+}
+
+static void
+CountRemovedEntries (uint32_t *count, const std::vector<aimf::SourceGroup> &added,
+                     const std::vector<aimf::SourceGroup> &removed)
+{
+  *count += removed.size ();
+}
+
+// The GOODBYE of DoStop must leave before the sockets close, not wait in
+// the queue for an aggregation window that never ends, and the entries
+// DoStop drops must be reported as removed.
+class AimfGoodbyeOnStopTestCase : public TestCase
+{
+public:
+  AimfGoodbyeOnStopTestCase ();
+  virtual ~AimfGoodbyeOnStopTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+AimfGoodbyeOnStopTestCase::AimfGoodbyeOnStopTestCase ()
+  : TestCase ("DoStop sends its GOODBYE before it closes the sockets and reports its withdrawn entries")
+{
+}
+
+AimfGoodbyeOnStopTestCase::~AimfGoodbyeOnStopTestCase ()
+{
+}
+
+void
+AimfGoodbyeOnStopTestCase::DoRun (void)
+{
+  NodeContainer source;
+  source.Create (1);
+  NodeContainer gateways;
+  gateways.Create (2);
+  AimfHelper aimf;
+  aimf.Set ("AggregationWindow", TimeValue (MilliSeconds (100)));
+  NetDeviceContainer lan;
+  Ipv4InterfaceContainer lanAddresses = BuildLan (source, gateways, aimf, lan);
+  Ptr<aimf::RoutingProtocol> gw0 = GetAimf (gateways.Get (0));
+  Simulator::Schedule (Seconds (1), &aimf::RoutingProtocol::AddHostMulticastAssociation,
+                       gw0, Ipv4Address ("225.1.2.4"), lanAddresses.GetAddress (0));
+  uint32_t removed = 0;
+  gw0->TraceConnectWithoutContext ("RoutingTableDelta", MakeBoundCallback (&CountRemovedEntries, &removed));
+  AimfPacketLog sent;
+  gw0->TraceConnectWithoutContext ("Tx", MakeBoundCallback (&LogAimfPacket, &sent));
+  AimfPacketLog received;
+  GetAimf (gateways.Get (1))->TraceConnectWithoutContext ("Rx", MakeBoundCallback (&LogAimfPacket, &received));
+
+  Simulator::Schedule (Seconds (5), &aimf::RoutingProtocol::DoStop, gw0);
+  Simulator::Stop (Seconds (6));
+  Simulator::Run ();
+
+  uint32_t goodbyes = 0;
+  for (uint32_t n = 0; n < sent.times.size (); n++)
+    {
+      if (sent.messages[n][aimf::MessageHeader::GOODBYE_MESSAGE] > 0)
+        {
+          goodbyes++;
+          NS_TEST_ASSERT_MSG_EQ (sent.times[n], Seconds (5), "The GOODBYE waited for the aggregation window");
+        }
+    }
+  NS_TEST_ASSERT_MSG_EQ (goodbyes, 1, "gw0 did not send its GOODBYE");
+  uint32_t receivedGoodbyes = 0;
+  for (uint32_t n = 0; n < received.times.size (); n++)
+    {
+      receivedGoodbyes += received.messages[n][aimf::MessageHeader::GOODBYE_MESSAGE];
+    }
+  NS_TEST_ASSERT_MSG_EQ (receivedGoodbyes, 1, "gw1 did not receive the GOODBYE");
+  NS_TEST_ASSERT_MSG_EQ (gw0->GetRoutingTableEntries ().size (), 0, "DoStop left entries");
+  NS_TEST_ASSERT_MSG_EQ (removed, 1, "RoutingTableDelta did not report the entries DoStop withdrew");
+
+  Simulator::Destroy ();
+}
+
+// Drops the first fragment of the given index of a fragmented full HELLO.
+class DropFragmentErrorModel : public ErrorModel
+{
+public:
+  DropFragmentErrorModel (uint8_t fragment)
+    : m_fragment (fragment),
+      m_dropped (false)
+  {
+  }
+
+private:
+  virtual bool DoCorrupt (Ptr<Packet> packet)
+  {
+    // An IPv4 packet of UDP to the AIMF port, past the IPv4 and UDP headers.
+    std::vector<uint8_t> bytes (packet->GetSize ());
+    if (m_dropped || bytes.size () <= 28)
+      {
+        return false;
+      }
+    packet->CopyData (&bytes[0], bytes.size ());
+    if ((bytes[0] >> 4) != 4 || bytes[9] != 17 || ((bytes[22] << 8) | bytes[23]) != 1337)
+      {
+        return false;
+      }
+    aimf::PacketReader reader (&bytes[28], bytes.size () - 28);
+    aimf::MessageView message;
+    aimf::HelloView hello;
+    while (reader.Next (message))
+      {
+        if (message.messageType == aimf::MessageHeader::HELLO_MESSAGE
+            && aimf::PacketReader::ReadHello (message, hello)
+            && hello.IsFull () && hello.fragments > 1 && hello.fragment == m_fragment)
+          {
+            m_dropped = true;
+            return true;
+          }
+      }
+    return false;
+  }
+  virtual void DoReset (void)
+  {
+    m_dropped = false;
+  }
+
+  uint8_t m_fragment;
+  bool m_dropped;
+};
+
+struct FullHellos
+{
+  uint32_t sent;
+  // Fragments of the last set sent.
+  uint32_t fragments;
+};
+
+static void
+CountFullHellos (FullHellos *count, Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t interface)
+{
+  std::vector<uint8_t> bytes (packet->GetSize ());
+  packet->CopyData (&bytes[0], bytes.size ());
+  aimf::PacketReader reader (&bytes[0], bytes.size ());
+  aimf::MessageView message;
+  aimf::HelloView hello;
+  while (reader.Next (message))
+    {
+      if (message.messageType == aimf::MessageHeader::HELLO_MESSAGE
+          && aimf::PacketReader::ReadHello (message, hello) && hello.IsFull ())
+        {
+          count->sent++;
+          count->fragments = hello.fragments;
+        }
+    }
+}
+
+// A neighbor that lost one fragment of a large association set keeps the
+// fragments that came and asks for the lost one only. Losing fragment 0 of
+// the first burst makes the neighbor learn of the gateway mid-burst.
+class AimfLostFragmentTestCase : public TestCase
+{
+public:
+  AimfLostFragmentTestCase (uint8_t fragment);
+  virtual ~AimfLostFragmentTestCase ();
+
+private:
+  virtual void DoRun (void);
+
+  uint8_t m_fragment;
+};
+
+AimfLostFragmentTestCase::AimfLostFragmentTestCase (uint8_t fragment)
+  : TestCase ("A lost fragment is asked for and resent alone"),
+    m_fragment (fragment)
+{
+}
+
+AimfLostFragmentTestCase::~AimfLostFragmentTestCase ()
+{
+}
+
+void
+AimfLostFragmentTestCase::DoRun (void)
+{
+  const uint32_t associationCount = 5000;
+  const uint32_t mtu = 1500;
+  NodeContainer source;
+  source.Create (1);
+  NodeContainer gateways;
+  gateways.Create (2);
+  AimfHelper aimf;
+  aimf.Set ("DeltaHello", BooleanValue (true));
+  aimf.Set ("FullHelloInterval", TimeValue (Seconds (60)));
+  NetDeviceContainer lan;
+  Ipv4InterfaceContainer lanAddresses = BuildLan (source, gateways, aimf, lan);
+  for (uint32_t i = 0; i < lan.GetN (); i++)
+    {
+      lan.Get (i)->SetMtu (mtu);
+    }
+  Ptr<DropFragmentErrorModel> errorModel = CreateObject<DropFragmentErrorModel> (m_fragment);
+  DynamicCast<SimpleNetDevice> (lan.Get (2))->SetReceiveErrorModel (errorModel);
+
+  // In place before the first, jittered, HELLO of gw0.
+  Ptr<aimf::RoutingProtocol> gw0 = GetAimf (gateways.Get (0));
+  for (uint32_t i = 0; i < associationCount; i++)
+    {
+      Simulator::Schedule (Seconds (0), &aimf::RoutingProtocol::AddHostMulticastAssociation,
+                           gw0, Ipv4Address (0xe1000000 + i), lanAddresses.GetAddress (0));
+    }
+  FullHellos fullHellos = {0, 0};
+  gw0->TraceConnectWithoutContext ("Tx", MakeBoundCallback (&CountFullHellos, &fullHellos));
+  Ptr<aimf::RoutingProtocol> gw1 = GetAimf (gateways.Get (1));
+  uint32_t removed = 0;
+  gw1->TraceConnectWithoutContext ("RoutingTableDelta", MakeBoundCallback (&CountRemovedEntries, &removed));
+  Simulator::Stop (Seconds (15));
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_GT (fullHellos.fragments, m_fragment + 1u, "The set was not split");
+  NS_TEST_ASSERT_MSG_EQ (gw1->GetRoutingTableEntries ().size (), associationCount,
+                         "gw1 did not learn every association");
+  NS_TEST_ASSERT_MSG_EQ (removed, 0, "Associations of a set being received expired");
+  NS_TEST_ASSERT_MSG_GT (fullHellos.sent, fullHellos.fragments, "gw0 did not resend the lost fragment");
+  // The set once and the lost fragment, maybe asked for twice, not the set again.
+  NS_TEST_ASSERT_MSG_LT (fullHellos.sent, fullHellos.fragments + 3, "gw0 resent fragments that were not lost");
+
+  gw0 = 0;
+  gw1 = 0;
+  Simulator::Destroy ();
+}
+
+// Keeps the first of the AIMF packets that reach a device within the
+// collision window of each other and drops the rest, as a shared channel
+// does with frames that overlap.
+class CollisionErrorModel : public ErrorModel
+{
+public:
+  CollisionErrorModel (Time window)
+    : m_window (window),
+      m_last (Seconds (-1)),
+      m_collisions (0)
+  {
+  }
+
+  uint32_t GetCollisions (void) const
+  {
+    return m_collisions;
+  }
+
+private:
+  virtual bool DoCorrupt (Ptr<Packet> packet)
+  {
+    std::vector<uint8_t> bytes (packet->GetSize ());
+    if (bytes.size () <= 28)
+      {
+        return false;
+      }
+    packet->CopyData (&bytes[0], bytes.size ());
+    if ((bytes[0] >> 4) != 4 || bytes[9] != 17 || ((bytes[22] << 8) | bytes[23]) != 1337)
+      {
+        return false;
+      }
+    if (m_last >= Seconds (0) && Simulator::Now () - m_last < m_window)
+      {
+        m_collisions++;
+        return true;
+      }
+    m_last = Simulator::Now ();
+    return false;
+  }
+  virtual void DoReset (void)
+  {
+    m_last = Seconds (-1);
+  }
+
+  Time m_window;
+  Time m_last;
+  uint32_t m_collisions;
+};
+
+static void
+LogHelloOriginators (std::set<Ipv4Address> *originators, Ptr<const Packet> packet, Ptr<Ipv4> ipv4, uint32_t interface)
+{
+  std::vector<uint8_t> bytes (packet->GetSize ());
+  packet->CopyData (&bytes[0], bytes.size ());
+  aimf::PacketReader reader (&bytes[0], bytes.size ());
+  aimf::MessageView message;
+  while (reader.Next (message))
+    {
+      if (message.messageType == aimf::MessageHeader::HELLO_MESSAGE)
+        {
+          originators->insert (message.originatorAddress);
+        }
+    }
+}
+
+static void
+CountNeighborLost (uint32_t *count, const Ipv4Address &neighbor)
+{
+  (*count)++;
+}
+
+// Gateways that start together send their HELLOs at the same instant
+// unless MaxJitter spreads them. Without jitter the HELLOs collide on
+// every interval; with it every gateway hears every other one and no
+// neighbor expires, although none ever leaves.
+class AimfHelloJitterTestCase : public TestCase
+{
+public:
+  AimfHelloJitterTestCase ();
+  virtual ~AimfHelloJitterTestCase ();
+
+private:
+  virtual void DoRun (void);
+  // Returns the collisions, fills the HELLO originators each gateway heard
+  // and counts the neighbor expiries.
+  uint32_t RunScenario (Time maxJitter, std::vector<std::set<Ipv4Address> > &heard, uint32_t &lost);
+
+  uint32_t m_gateways;
+};
+
+AimfHelloJitterTestCase::AimfHelloJitterTestCase ()
+  : TestCase ("Jittered HELLOs of gateways that start together do not collide"),
+    m_gateways (10)
+{
+}
+
+AimfHelloJitterTestCase::~AimfHelloJitterTestCase ()
+{
+}
+
+uint32_t
+AimfHelloJitterTestCase::RunScenario (Time maxJitter, std::vector<std::set<Ipv4Address> > &heard, uint32_t &lost)
+{
+  NodeContainer source;
+  source.Create (1);
+  NodeContainer gateways;
+  gateways.Create (m_gateways);
+  AimfHelper aimf;
+  aimf.Set ("MaxJitter", TimeValue (maxJitter));
+  NetDeviceContainer lan;
+  BuildLan (source, gateways, aimf, lan);
+
+  // A HELLO of about 100 bytes at 1 Mbit/s.
+  std::vector<Ptr<CollisionErrorModel> > errorModels;
+  heard.assign (m_gateways, std::set<Ipv4Address> ());
+  lost = 0;
+  for (uint32_t i = 0; i < m_gateways; i++)
+    {
+      errorModels.push_back (CreateObject<CollisionErrorModel> (MilliSeconds (1)));
+      DynamicCast<SimpleNetDevice> (lan.Get (i + 1))->SetReceiveErrorModel (errorModels.back ());
+      Ptr<aimf::RoutingProtocol> gateway = GetAimf (gateways.Get (i));
+      gateway->TraceConnectWithoutContext ("Rx", MakeBoundCallback (&LogHelloOriginators, &heard[i]));
+      gateway->TraceConnectWithoutContext ("NeighborLost", MakeBoundCallback (&CountNeighborLost, &lost));
+    }
+  Simulator::Stop (Seconds (60));
+  Simulator::Run ();
+
+  uint32_t collisions = 0;
+  for (uint32_t i = 0; i < m_gateways; i++)
+    {
+      collisions += errorModels[i]->GetCollisions ();
+    }
+  Simulator::Destroy ();
+  return collisions;
+}
+
+void
+AimfHelloJitterTestCase::DoRun (void)
+{
+  std::vector<std::set<Ipv4Address> > heard;
+  uint32_t lost;
+  uint32_t collisions = RunScenario (Seconds (0), heard, lost);
+  NS_TEST_ASSERT_MSG_GT (collisions, 0, "HELLOs sent at the same instant did not collide");
+
+  RunScenario (MilliSeconds (500), heard, lost);
+  NS_TEST_ASSERT_MSG_EQ (lost, 0, "A neighbor expired although no gateway left");
+  for (uint32_t i = 0; i < m_gateways; i++)
+    {
+      NS_TEST_ASSERT_MSG_EQ (heard[i].size (), m_gateways - 1, "A gateway never heard some of the others");
+    }
+}
+
+// The unicast routes of LookupStatic: the longest prefix wins, the lowest
+// metric among routes of that length, the route inserted last on a metric
+// tie, and only routes through the interface asked for.
+class AimfLpmTableTestCase : public TestCase
+{
+public:
+  AimfLpmTableTestCase ();
+  virtual ~AimfLpmTableTestCase ();
+
+private:
+  virtual void DoRun (void);
+  // The interface of the route found, -1 if there is none.
+  int32_t Lookup (const char *dest, uint32_t interface) const;
+
+  aimf::LpmTable m_table;
+};
+
+AimfLpmTableTestCase::AimfLpmTableTestCase ()
+  : TestCase ("Longest prefix match of the unicast routes")
+{
+}
+
+AimfLpmTableTestCase::~AimfLpmTableTestCase ()
+{
+}
+
+int32_t
+AimfLpmTableTestCase::Lookup (const char *dest, uint32_t interface) const
+{
+  const aimf::LpmTable::Route *route = m_table.Lookup (Ipv4Address (dest), interface);
+  return route ? (int32_t) route->entry.GetInterface () : -1;
+}
+
+void
+AimfLpmTableTestCase::DoRun (void)
+{
+  m_table.Insert (Ipv4RoutingTableEntry::CreateNetworkRouteTo (Ipv4Address ("10.0.0.0"), Ipv4Mask ("255.0.0.0"),
+                                                               Ipv4Address ("10.255.0.1"), 1), 0);
+  NS_TEST_ASSERT_MSG_EQ (Lookup ("10.1.2.3", Ipv4::IF_ANY), 1, "The /8 route was not found");
+
+  // A longer prefix overrides a shorter one, even with a higher metric.
+  m_table.Insert (Ipv4RoutingTableEntry::CreateNetworkRouteTo (Ipv4Address ("10.1.0.0"), Ipv4Mask ("255.255.0.0"),
+                                                               Ipv4Address ("10.1.0.254"), 2), 5);
+  NS_TEST_ASSERT_MSG_EQ (Lookup ("10.1.2.3", Ipv4::IF_ANY), 2, "The /16 route did not override the /8 one");
+  NS_TEST_ASSERT_MSG_EQ (Lookup ("10.2.0.1", Ipv4::IF_ANY), 1, "The /16 route matched outside its prefix");
+  NS_TEST_ASSERT_MSG_EQ (Lookup ("11.0.0.1", Ipv4::IF_ANY), -1, "A route matched outside every prefix");
+
+  // Among routes of the same length the lowest metric wins, whatever the order.
+  m_table.Insert (Ipv4RoutingTableEntry::CreateNetworkRouteTo (Ipv4Address ("10.1.0.0"), Ipv4Mask ("255.255.0.0"),
+                                                               Ipv4Address ("10.1.0.253"), 3), 1);
+  NS_TEST_ASSERT_MSG_EQ (Lookup ("10.1.2.3", Ipv4::IF_ANY), 3, "The lower metric did not win");
+  m_table.Insert (Ipv4RoutingTableEntry::CreateNetworkRouteTo (Ipv4Address ("10.1.0.0"), Ipv4Mask ("255.255.0.0"),
+                                                               Ipv4Address ("10.1.0.252"), 4), 3);
+  NS_TEST_ASSERT_MSG_EQ (Lookup ("10.1.2.3", Ipv4::IF_ANY), 3, "A higher metric inserted later won");
+  // On a tie the route inserted last wins, as in Ipv4StaticRouting.
+  m_table.Insert (Ipv4RoutingTableEntry::CreateNetworkRouteTo (Ipv4Address ("172.16.0.0"), Ipv4Mask ("255.240.0.0"),
+                                                               Ipv4Address ("10.1.0.254"), 2), 2);
+  m_table.Insert (Ipv4RoutingTableEntry::CreateNetworkRouteTo (Ipv4Address ("172.16.0.0"), Ipv4Mask ("255.240.0.0"),
+                                                               Ipv4Address ("10.1.0.253"), 3), 2);
+  NS_TEST_ASSERT_MSG_EQ (Lookup ("172.20.0.1", Ipv4::IF_ANY), 3, "The metric tie was not broken by the last route");
+  // Inserting a route again replaces it.
+  m_table.Insert (Ipv4RoutingTableEntry::CreateNetworkRouteTo (Ipv4Address ("172.16.0.0"), Ipv4Mask ("255.240.0.0"),
+                                                               Ipv4Address ("10.1.0.253"), 3), 2);
+  NS_TEST_ASSERT_MSG_EQ (m_table.GetNRoutes (), 6, "A route inserted twice was counted twice");
+
+  // The interface filter skips the routes through other interfaces, a
+  // shorter prefix through the interface then matches.
+  NS_TEST_ASSERT_MSG_EQ (Lookup ("10.1.2.3", 2), 2, "The filter took a route through another interface");
+  NS_TEST_ASSERT_MSG_EQ (Lookup ("10.1.2.3", 4), 4, "The filter missed the higher metric route");
+  NS_TEST_ASSERT_MSG_EQ (Lookup ("10.1.2.3", 1), 1, "The filter did not fall back to the /8 route");
+  NS_TEST_ASSERT_MSG_EQ (Lookup ("10.1.2.3", 5), -1, "The filter took a route through another interface");
+
+  // The default route sits at the root and matches what nothing else does.
+  m_table.Insert (Ipv4RoutingTableEntry::CreateNetworkRouteTo (Ipv4Address ("0.0.0.0"), Ipv4Mask ("0.0.0.0"),
+                                                               Ipv4Address ("10.1.0.1"), 5), 0);
+  NS_TEST_ASSERT_MSG_EQ (Lookup ("192.168.1.1", Ipv4::IF_ANY), 5, "The default route was not found");
+  NS_TEST_ASSERT_MSG_EQ (Lookup ("10.1.2.3", Ipv4::IF_ANY), 3, "The default route overrode a longer prefix");
+  NS_TEST_ASSERT_MSG_EQ (Lookup ("10.1.2.3", 5), 5, "The filter did not fall back to the default route");
+
+  // Removing the 0 length prefix removes the default route only.
+  NS_TEST_ASSERT_MSG_EQ (m_table.Remove (Ipv4Address ("0.0.0.0"), Ipv4Mask ("0.0.0.0")), 1,
+                         "The default route was not removed");
+  NS_TEST_ASSERT_MSG_EQ (Lookup ("192.168.1.1", Ipv4::IF_ANY), -1, "The removed default route was found");
+  NS_TEST_ASSERT_MSG_EQ (m_table.GetNRoutes (), 6, "Remove of the default route took other routes");
+  NS_TEST_ASSERT_MSG_EQ (m_table.Remove (Ipv4Address ("0.0.0.0"), Ipv4Mask ("0.0.0.0")), 0,
+                         "The default route was removed twice");
+  NS_TEST_ASSERT_MSG_EQ (m_table.Remove (Ipv4Address ("10.1.0.0"), Ipv4Mask ("255.255.0.0")), 3,
+                         "The /16 routes were not removed");
+  NS_TEST_ASSERT_MSG_EQ (m_table.Remove (Ipv4Address ("192.168.0.0"), Ipv4Mask ("255.255.0.0")), 0,
+                         "A prefix without routes was removed");
+  NS_TEST_ASSERT_MSG_EQ (Lookup ("10.1.2.3", Ipv4::IF_ANY), 1, "The /8 route did not take over");
+  NS_TEST_ASSERT_MSG_EQ (m_table.GetNRoutes (), 3, "The route count is wrong after the removes");
+
+  m_table.Clear ();
+}
+
 // The TestSuite class names the TestSuite, identifies what type of TestSuite,
 // and enables the TestCases to be run.  Typically, only the constructor for
 // this class must be defined
@@ -61,6 +1644,23 @@ AimfTestSuite::AimfTestSuite ()
 {
   // TestDuration for TestCase can be QUICK, EXTENSIVE or TAKES_FOREVER
   AddTestCase (new AimfTestCase1, TestCase::QUICK);
+  AddTestCase (new AimfSingleForwarderTestCase (2, false), TestCase::QUICK);
+  AddTestCase (new AimfSingleForwarderTestCase (5, false), TestCase::QUICK);
+  AddTestCase (new AimfSingleForwarderTestCase (5, true), TestCase::QUICK);
+  AddTestCase (new AimfLoadSharingTestCase, TestCase::QUICK);
+  AddTestCase (new AimfLearnedRoutesTestCase, TestCase::QUICK);
+  AddTestCase (new AimfLargeAssociationSetTestCase, TestCase::QUICK);
+  AddTestCase (new AimfMalformedPacketTestCase, TestCase::QUICK);
+  AddTestCase (new AimfHelloTemplateTestCase, TestCase::QUICK);
+  AddTestCase (new AimfGroupPrefixRecordTestCase, TestCase::QUICK);
+  AddTestCase (new AimfGroupPrefixLookupTestCase, TestCase::QUICK);
+  AddTestCase (new AimfMessageQueueTestCase (MilliSeconds (10)), TestCase::QUICK);
+  AddTestCase (new AimfMessageQueueTestCase (Seconds (0)), TestCase::QUICK);
+  AddTestCase (new AimfGoodbyeOnStopTestCase, TestCase::QUICK);
+  AddTestCase (new AimfLostFragmentTestCase (0), TestCase::QUICK);
+  AddTestCase (new AimfLostFragmentTestCase (3), TestCase::QUICK);
+  AddTestCase (new AimfHelloJitterTestCase, TestCase::QUICK);
+  AddTestCase (new AimfLpmTableTestCase, TestCase::QUICK);
 }
 
 // Do not forget to allocate an instance of this TestSuite